@@ -0,0 +1,656 @@
+#!/usr/bin/env node
+// bench.js - end-to-end benchmark of gnunet-web in headless Chrome
+// Copyright (C) 2026  agent <agent@local>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Usage: node bench.js [--mb N] [--records N] [--timeout S] [--chrome PATH]
+//                      [--relay-port PORT] [--layout L] [--out FILE] [DIR]
+//
+// Serves DIR, the site `boot prod` writes to target/, on localhost with an
+// empty hostlist, starts websocket-relay.js as the only other peer, and
+// opens bench.html in two headless Chrome profiles, peers a and b.  Peer a
+// publishes N MiB (default 4), searches for it and downloads it back, then
+// both peers connect to each other through the relay and b goes away.
+// Meanwhile peer b fills a scratch peerstore database with N records
+// (default 10000) and times lookups by each prefix the peerstore plugin
+// supports, and checks that a record it stores through one peerstore
+// connection reaches the watch of another.
+// Every worker of both peers reports its heap, the time it spent running
+// scheduler tasks, the messages and bytes on each of its sockets and the
+// plugins it fetched.
+// --layout workers (the default) runs each service in a worker of its
+// own, node runs them all in gnunet-node.js and both runs the benchmark
+// once each way and compares their heaps and latencies.  The report is
+// written as JSON to FILE or stdout, and bench.js exits with 1 if a check
+// failed.  Only node's standard library is used; the browser is driven
+// with the DevTools protocol.
+
+var child_process = require('child_process');
+var crypto = require('crypto');
+var fs = require('fs');
+var http = require('http');
+var os = require('os');
+var path = require('path');
+
+function option(name, fallback) {
+  var i = process.argv.indexOf(name);
+  if (i < 0) {
+    return fallback;
+  }
+  return process.argv.splice(i, 2)[1];
+}
+
+var mb = parseFloat(option('--mb', '4'));
+var records = parseInt(option('--records', '10000'), 10);
+var timeout_ms = 1000 * parseFloat(option('--timeout', '120'));
+var chrome = option('--chrome', process.env.CHROME || 'chromium');
+var relay_port = parseInt(option('--relay-port', '8081'), 10);
+var layout = option('--layout', 'workers');
+var out = option('--out', null);
+var dir = path.resolve(process.argv[2] || 'target');
+
+var types = {
+  '.css': 'text/css',
+  '.html': 'text/html',
+  '.js': 'application/javascript',
+  '.mem': 'application/octet-stream',
+  '.wasm': 'application/wasm',
+};
+
+// The site, with an empty hostlist so the peers stay on localhost
+function serve(callback) {
+  var server = http.createServer(function(req, res) {
+    var name = decodeURIComponent(req.url.split('?')[0]);
+    if ('/hostlist' == name) {
+      res.writeHead(200, {'Content-Type': 'application/octet-stream'});
+      res.end();
+      return;
+    }
+    // Pick the layout service.cljs reads from localStorage, then load
+    // bench.html
+    if ('/bench-layout' == name) {
+      var node = 'node' == req.url.split('?')[1];
+      res.writeHead(200, {'Content-Type': 'text/html'});
+      res.end('<script>localStorage.setItem("node", "' + node + '");' +
+              'location.replace("/bench.html");</script>');
+      return;
+    }
+    var file = path.join(dir, path.normalize(name));
+    if (0 != file.lastIndexOf(dir, 0)) {
+      res.writeHead(403);
+      res.end();
+      return;
+    }
+    fs.readFile(file, function(err, data) {
+      if (err) {
+        res.writeHead(404);
+        res.end();
+        return;
+      }
+      res.writeHead(200, {
+        'Content-Type': types[path.extname(file)] || 'application/octet-stream'
+      });
+      res.end(data);
+    });
+  });
+  server.listen(0, 'localhost', function() {
+    callback(server);
+  });
+}
+
+// Messages and bytes the relay reported, it prints them every 10 seconds
+var relay_stats = {messages: 0, bytes: 0};
+
+function start_relay() {
+  var relay = child_process.spawn(process.execPath, [
+    path.join(__dirname, 'websocket-relay.js'),
+    String(relay_port)]);
+  relay.stdout.on('data', function(data) {
+    String(data).split('\n').forEach(function(line) {
+      if ('{' == line.charAt(0)) {
+        var stats = JSON.parse(line);
+        relay_stats.messages += stats.messages;
+        relay_stats.bytes += stats.bytes;
+      }
+    });
+  });
+  relay.stderr.pipe(process.stderr);
+  return relay;
+}
+
+// A client for one WebSocket of the DevTools protocol
+function Devtools(socket) {
+  var self = this;
+  this.socket = socket;
+  this.next_id = 1;
+  this.calls = {};
+  this.fragments = [];
+  var pending = Buffer.alloc(0);
+  socket.on('data', function(data) {
+    pending = self.parse(Buffer.concat([pending, data]));
+  });
+}
+
+// Frames from the client are masked
+Devtools.prototype.send_frame = function(payload) {
+  var header;
+  if (payload.length < 126) {
+    header = Buffer.from([0x81, 0x80 | payload.length]);
+  } else if (payload.length < 65536) {
+    header = Buffer.from([0x81, 0x80 | 126, 0, 0]);
+    header.writeUInt16BE(payload.length, 2);
+  } else {
+    header = Buffer.from([0x81, 0x80 | 127, 0, 0, 0, 0, 0, 0, 0, 0]);
+    header.writeUInt32BE(payload.length, 6);
+  }
+  var mask = crypto.randomBytes(4);
+  var masked = Buffer.alloc(payload.length);
+  for (var i = 0; i < payload.length; i++) {
+    masked[i] = payload[i] ^ mask[i & 3];
+  }
+  this.socket.write(Buffer.concat([header, mask, masked]));
+};
+
+// Parse server frames out of buf; returns the unparsed remainder
+Devtools.prototype.parse = function(buf) {
+  while (buf.length >= 2) {
+    var opcode = buf[0] & 0x0f;
+    var fin = buf[0] & 0x80;
+    var length = buf[1] & 0x7f;
+    var offset = 2;
+    if (126 == length) {
+      if (buf.length < 4) break;
+      length = buf.readUInt16BE(2);
+      offset = 4;
+    } else if (127 == length) {
+      if (buf.length < 10) break;
+      length = buf.readUInt32BE(6);
+      offset = 10;
+    }
+    if (buf.length < offset + length) break;
+    var payload = buf.slice(offset, offset + length);
+    buf = buf.slice(offset + length);
+    if (0 == opcode || 1 == opcode) {
+      this.fragments.push(payload);
+      if (fin) {
+        this.receive(JSON.parse(Buffer.concat(this.fragments)));
+        this.fragments = [];
+      }
+    }
+  }
+  return buf;
+};
+
+Devtools.prototype.receive = function(message) {
+  if (!('id' in message) || !(message.id in this.calls)) {
+    return;
+  }
+  var call = this.calls[message.id];
+  delete this.calls[message.id];
+  if (message.error) {
+    call.reject(new Error(call.method + ': ' + message.error.message));
+  } else {
+    call.resolve(message.result);
+  }
+};
+
+Devtools.prototype.call = function(method, params, session) {
+  var self = this;
+  var id = this.next_id++;
+  return new Promise(function(resolve, reject) {
+    self.calls[id] = {method: method, resolve: resolve, reject: reject};
+    var message = {id: id, method: method, params: params || {}};
+    if (session) {
+      message.sessionId = session;
+    }
+    self.send_frame(Buffer.from(JSON.stringify(message)));
+  });
+};
+
+function devtools_connect(port, path) {
+  return new Promise(function(resolve, reject) {
+    var req = http.request({
+      host: 'localhost',
+      port: port,
+      path: path,
+      headers: {
+        'Connection': 'Upgrade',
+        'Upgrade': 'websocket',
+        'Sec-WebSocket-Key': crypto.randomBytes(16).toString('base64'),
+        'Sec-WebSocket-Version': '13',
+      }});
+    req.on('upgrade', function(res, socket) {
+      socket.setNoDelay(true);
+      resolve(new Devtools(socket));
+    });
+    req.on('error', reject);
+    req.end();
+  });
+}
+
+function sleep(ms) {
+  return new Promise(function(resolve) { setTimeout(resolve, ms); });
+}
+
+// Start Chrome with a fresh profile, so each peer has its own key and
+// storage, and connect to it
+async function start_browser(name) {
+  var profile = fs.mkdtempSync(path.join(os.tmpdir(), 'gnunet-bench-' + name));
+  var proc = child_process.spawn(chrome, [
+    '--headless',
+    '--disable-gpu',
+    '--no-first-run',
+    '--no-default-browser-check',
+    '--user-data-dir=' + profile,
+    '--remote-debugging-port=0',
+    'about:blank'], {stdio: 'ignore'});
+  var failed = null;
+  proc.on('error', function(e) { failed = e; });
+  // Chrome writes the port it picked and the browser's path here
+  var active = path.join(profile, 'DevToolsActivePort');
+  for (var tries = 0; !fs.existsSync(active); tries++) {
+    if (failed) {
+      throw new Error('Failed to start ' + chrome + ': ' + failed.message);
+    }
+    if (tries > 100) {
+      throw new Error('Chrome did not start: ' + chrome);
+    }
+    await sleep(100);
+  }
+  await sleep(100);
+  var lines = fs.readFileSync(active, 'utf8').split('\n');
+  var devtools = await devtools_connect(parseInt(lines[0], 10), lines[1]);
+  return {name: name, proc: proc, profile: profile, devtools: devtools};
+}
+
+function stop_browser(browser) {
+  browser.proc.kill();
+  browser.proc.on('exit', function() {
+    child_process.spawnSync('rm', ['-rf', browser.profile]);
+  });
+}
+
+async function evaluate(browser, expression) {
+  var result = await browser.devtools.call('Runtime.evaluate', {
+    expression: expression,
+    awaitPromise: true,
+    returnByValue: true,
+  }, browser.session);
+  if (result.exceptionDetails) {
+    throw new Error(browser.name + ': ' + expression + ': ' +
+                    result.exceptionDetails.text);
+  }
+  return result.result.value;
+}
+
+// Open bench.html and wait for gnunet-web.bench to load
+async function open_page(browser, url) {
+  var start = Date.now();
+  var target = await browser.devtools.call('Target.createTarget', {url: url});
+  var attached = await browser.devtools.call('Target.attachToTarget', {
+    targetId: target.targetId,
+    flatten: true,
+  });
+  browser.target = target.targetId;
+  browser.session = attached.sessionId;
+  while (!await evaluate(browser, "typeof gnunet_web !== 'undefined' && " +
+                                  "typeof gnunet_web.bench !== 'undefined'")) {
+    if (Date.now() - start > timeout_ms) {
+      throw new Error(browser.name + ': bench.html did not load');
+    }
+    await sleep(100);
+  }
+  return {ms: Date.now() - start};
+}
+
+// Runs in a worker of bench.html, after peerstore-pre.js.  Fills the
+// database peerstore-bench with records spread over a few sub systems,
+// 100 peers and a few keys, then opens cursors the way
+// peerstore_emscripten_iterate_records_int does and reports the mean time
+// of a lookup and the records it found, for each kind of lookup.
+async function peerstore_bench(records) {
+  var name = 'peerstore-bench';
+  var lookups = 50;
+  var sub_systems = ['transport', 'topology', 'nse'];
+  var keys = ['hello', 'address', 'preference', 'seen'];
+  var peers = [];
+  for (var i = 0; i < 100; i++) {
+    peers.push(crypto.getRandomValues(new Uint8Array(32)));
+  }
+  var pick = function(a) {
+    return a[Math.floor(Math.random() * a.length)];
+  };
+  var done = function(request) {
+    return new Promise(function(resolve, reject) {
+      request.onsuccess = function(e) { resolve(e.target.result); };
+      request.onerror = function(e) { reject(e.target.error); };
+    });
+  };
+  await done(indexedDB.deleteDatabase(name));
+  var db = await new Promise(function(resolve, reject) {
+    peerstore_open(name, function(db) {
+      db ? resolve(db) : reject(new Error('cannot open ' + name));
+    });
+  });
+  var start = performance.now();
+  var transaction = db.transaction(['records'], 'readwrite');
+  var store = transaction.objectStore('records');
+  for (var i = 0; i < records; i++) {
+    var record = {
+      sub_system: pick(sub_systems),
+      peer: pick(peers),
+      key: pick(keys),
+      value: crypto.getRandomValues(new Uint8Array(8 + i % 56)),
+      expiry: Date.now() + 3600 * 1000};
+    store.put(record, peerstore_key(record.sub_system, record.peer,
+                                    record.key, record.value));
+  }
+  await new Promise(function(resolve, reject) {
+    transaction.oncomplete = resolve;
+    transaction.onabort = function() { reject(transaction.error); };
+  });
+  var report = {records: records, fill_ms: performance.now() - start};
+  var kinds = {
+    sub_system: function() { return [pick(sub_systems), null, null]; },
+    peer: function() { return [pick(sub_systems), pick(peers), null]; },
+    key: function() { return [pick(sub_systems), null, pick(keys)]; },
+    peer_key: function() {
+      return [pick(sub_systems), pick(peers), pick(keys)];
+    },
+  };
+  for (var kind in kinds) {
+    var found = 0;
+    start = performance.now();
+    for (var i = 0; i < lookups; i++) {
+      var args = kinds[kind]();
+      var store = db.transaction(['records'], 'readonly')
+                    .objectStore('records');
+      await new Promise(function(resolve, reject) {
+        var request = peerstore_lookup(store, args[0], args[1], args[2]);
+        request.onsuccess = function(e) {
+          var cursor = e.target.result;
+          if (cursor) {
+            found++;
+            cursor.continue();
+          } else {
+            resolve();
+          }
+        };
+        request.onerror = function(e) { reject(e.target.error); };
+      });
+    }
+    report[kind] = {
+      ms: (performance.now() - start) / lookups,
+      found: found / lookups,
+    };
+  }
+  db.close();
+  await done(indexedDB.deleteDatabase(name));
+  return report;
+}
+
+// Run peerstore_bench in a worker of the page, so peerstore-pre.js gets
+// globals of its own
+function peerstore_bench_expression() {
+  var source = 'var Module = {preInit: []};\n' +
+    fs.readFileSync(path.join(__dirname, 'gnunet-build', 'packages',
+                              'gnunet', 'gnunet', 'files',
+                              'peerstore-pre.js'), 'utf8') +
+    '\n' + peerstore_bench.toString() + '\n' +
+    'peerstore_bench(' + records + ').then(postMessage, function(e) {\n' +
+    '  postMessage({error: String(e)});\n' +
+    '});\n';
+  return 'new Promise(function(resolve, reject) {\n' +
+    '  var worker = new Worker(URL.createObjectURL(new Blob([' +
+    JSON.stringify(source) + '])));\n' +
+    '  worker.onmessage = function(e) {\n' +
+    '    worker.terminate();\n' +
+    '    e.data.error ? reject(new Error(e.data.error)) : resolve(e.data);\n' +
+    '  };\n' +
+    '  worker.onerror = function(e) { reject(new Error(e.message)); };\n' +
+    '})';
+}
+
+function rate(result) {
+  if (result && result.bytes && result.ms) {
+    result.bytes_per_sec = Math.round(result.bytes * 1000 / result.ms);
+  }
+  return result;
+}
+
+// Which build a peer ran, wasm or asm.js, how many of its workers started
+// from a snapshot and the time its slowest worker took to parse, compile,
+// start and accept its first connection, from the workers' startup
+// timings
+function startup(stats) {
+  var result = {build: null, snapshots: 0, parsed_ms: 0, compiled_ms: 0,
+                started_ms: 0, first_accept_ms: 0};
+  Object.keys(stats || {}).forEach(function(name) {
+    var times = stats[name].startup;
+    if (!times) {
+      return;
+    }
+    result.build = times.build;
+    if (times.snapshot) {
+      result.snapshots++;
+    }
+    ['parsed_ms', 'compiled_ms', 'started_ms',
+     'first_accept_ms'].forEach(function(key) {
+      result[key] = Math.max(result[key], times[key] || 0);
+    });
+  });
+  return result;
+}
+
+// The bytes of every plugin in dir, which each worker preloaded before
+// plugins were fetched on first load
+function plugin_bytes(dir) {
+  var bytes = 0;
+  fs.readdirSync(dir).forEach(function(name) {
+    var file = path.join(dir, name);
+    var stat = fs.statSync(file);
+    if (stat.isDirectory()) {
+      bytes += plugin_bytes(file);
+    } else if (/^libgnunet_plugin_.*\.(js|wasm)$/.test(name)) {
+      bytes += stat.size;
+    }
+  });
+  return bytes;
+}
+
+// The plugins a peer's workers fetched, their bytes and time, and the
+// bytes they no longer fetch at startup.  saved_ms estimates the time
+// those would have taken at the rate the fetched plugins came in.
+function plugins(stats, available) {
+  var result = {workers: 0, fetched: 0, fetched_bytes: 0, fetch_ms: 0,
+                available_bytes: available, saved_bytes: 0, saved_ms: null};
+  Object.keys(stats || {}).forEach(function(name) {
+    var fetched = stats[name].plugins;
+    if (!fetched) {
+      return;
+    }
+    result.workers++;
+    result.fetched += fetched.count;
+    result.fetched_bytes += fetched.bytes;
+    result.fetch_ms += fetched.ms;
+  });
+  result.saved_bytes = result.workers * available - result.fetched_bytes;
+  if (result.fetched_bytes && result.fetch_ms) {
+    result.saved_ms = Math.round(result.saved_bytes * result.fetch_ms /
+                                 result.fetched_bytes);
+  }
+  return result;
+}
+
+// Turn the workers' busy milliseconds into a share of the wall time
+function workers(stats, wall_ms) {
+  Object.keys(stats || {}).forEach(function(name) {
+    stats[name].busy_share = stats[name].busy / wall_ms;
+  });
+  return stats;
+}
+
+// Run the benchmark with the services laid out as layout, workers or node
+async function run(server, layout) {
+  var site = 'http://localhost:' + server.address().port + '/bench-layout?' +
+             layout;
+  var relay_url = 'ws://localhost:' + relay_port + '/';
+  var keyword = 'bench-' + crypto.randomBytes(4).toString('hex');
+  var start = Date.now();
+  var report = {
+    date: new Date().toISOString(),
+    layout: layout,
+    mb: mb,
+    records: records,
+    scenarios: {},
+    failed: [],
+  };
+  relay_stats = {messages: 0, bytes: 0};
+  var a = await start_browser('a');
+  var b = await start_browser('b');
+  try {
+    report.scenarios.open = {
+      a: await open_page(a, site),
+      b: await open_page(b, site),
+    };
+    var peerstore = evaluate(b, peerstore_bench_expression());
+    peerstore.catch(function() {});  // awaited below
+    var q = JSON.stringify(keyword);
+    var publish = report.scenarios.publish =
+      rate(await evaluate(a, 'gnunet_web.bench.publish(' + mb + ', ' + q +
+                             ')'));
+    report.scenarios.search =
+      await evaluate(a, 'gnunet_web.bench.search(' + q + ')');
+    report.scenarios.download =
+      rate(await evaluate(a, 'gnunet_web.bench.download(' +
+                             JSON.stringify(publish.uri) + ')'));
+    report.scenarios.peerstore = await peerstore;
+    var watch = report.scenarios.peerstore_watch =
+      await evaluate(b, 'gnunet_web.bench.peerstore_watch()');
+    if (!watch.stored || !watch.fired || !watch.matches) {
+      report.failed.push('peerstore_watch');
+    }
+    var id_a = await evaluate(a, 'gnunet_web.bench.peer_id()');
+    var id_b = await evaluate(b, 'gnunet_web.bench.peer_id()');
+    var relay = JSON.stringify(relay_url);
+    await evaluate(a, 'gnunet_web.bench.offer_peer(' + JSON.stringify(id_b) +
+                      ', ' + relay + ')');
+    await evaluate(b, 'gnunet_web.bench.offer_peer(' + JSON.stringify(id_a) +
+                      ', ' + relay + ')');
+    report.scenarios.connect =
+      await evaluate(a, 'gnunet_web.bench.wait_connected(' +
+                        JSON.stringify(id_b) + ', ' + timeout_ms + ')');
+    var wall_ms = Date.now() - start;
+    report.workers = {
+      a: workers(await evaluate(a, 'gnunet_web.bench.worker_stats()'),
+                 wall_ms),
+      b: workers(await evaluate(b, 'gnunet_web.bench.worker_stats()'),
+                 wall_ms),
+    };
+    report.startup = {
+      a: startup(report.workers.a),
+      b: startup(report.workers.b),
+    };
+    var available = plugin_bytes(dir);
+    report.plugins = {
+      a: plugins(report.workers.a, available),
+      b: plugins(report.workers.b, available),
+    };
+    await b.devtools.call('Target.closeTarget', {targetId: b.target});
+    report.scenarios.disconnect =
+      await evaluate(a, 'gnunet_web.bench.wait_disconnected(' +
+                        JSON.stringify(id_b) + ', ' + timeout_ms + ')');
+  } finally {
+    stop_browser(a);
+    stop_browser(b);
+  }
+  report.wall_ms = Date.now() - start;
+  report.relay = relay_stats;
+  return report;
+}
+
+// The heap every worker of both peers holds and the latencies of a run
+function summary(report) {
+  var heap = {size: 0, high: 0};
+  ['a', 'b'].forEach(function(peer) {
+    var stats = report.workers[peer] || {};
+    Object.keys(stats).forEach(function(name) {
+      heap.size += stats[name].size || 0;
+      heap.high += stats[name].high || 0;
+    });
+  });
+  return {
+    build: report.startup.a.build,
+    started_ms: report.startup.a.started_ms,
+    first_accept_ms: report.startup.a.first_accept_ms,
+    plugin_bytes: report.plugins.a.fetched_bytes,
+    plugin_saved_bytes: report.plugins.a.saved_bytes,
+    heap_bytes: heap.size,
+    heap_high_bytes: heap.high,
+    open_ms: report.scenarios.open.a.ms,
+    publish_ms: report.scenarios.publish.ms,
+    search_ms: report.scenarios.search.ms,
+    download_ms: report.scenarios.download.ms,
+    peerstore_watch_ms: report.scenarios.peerstore_watch.ms,
+    connect_ms: report.scenarios.connect.ms,
+    disconnect_ms: report.scenarios.disconnect.ms,
+  };
+}
+
+async function run_layouts(server) {
+  if ('both' != layout) {
+    return await run(server, layout);
+  }
+  var workers = await run(server, 'workers');
+  var node = await run(server, 'node');
+  return {
+    layouts: {workers: workers, node: node},
+    comparison: {workers: summary(workers), node: summary(node)},
+    failed: workers.failed.map(function(f) { return 'workers: ' + f; })
+      .concat(node.failed.map(function(f) { return 'node: ' + f; })),
+  };
+}
+
+if (['workers', 'node', 'both'].indexOf(layout) < 0) {
+  console.error('--layout must be workers, node or both');
+  process.exit(1);
+}
+if (!fs.existsSync(path.join(dir, 'bench.html'))) {
+  console.error('No bench.html in ' + dir + ', run `boot prod` first');
+  process.exit(1);
+}
+var relay = start_relay();
+serve(function(server) {
+  run_layouts(server).then(function(report) {
+    var json = JSON.stringify(report, null, 2) + '\n';
+    if (out) {
+      fs.writeFileSync(out, json);
+    } else {
+      process.stdout.write(json);
+    }
+    if (0 != report.failed.length) {
+      console.error('Failed:', report.failed.join(' '));
+      process.exitCode = 1;
+    }
+  }).catch(function(e) {
+    console.error(e.stack || e);
+    process.exitCode = 1;
+  }).then(function() {
+    relay.kill();
+    server.close();
+  });
+});
+
+// vim: set expandtab ts=2 sw=2:
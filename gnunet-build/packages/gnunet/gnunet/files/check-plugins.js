@@ -0,0 +1,92 @@
+// check-plugins.js - load a service's plugins against its exports
+// Copyright (C) 2026  agent <agent@local>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Usage: node check-plugins.js gnunet-service-foo.js libgnunet_plugin_bar.wasm...
+//
+// Runs the service in node up to its main() and dlopen()s each plugin in
+// it.  emscripten only fails a call to a function the main module doesn't
+// export when it is made, so every function and data symbol a plugin
+// imports is looked up first.  Exits with 1 if any is missing, the plugin
+// fails to load or it has no init function.
+
+var fs = require('fs');
+var path = require('path');
+var vm = require('vm');
+var plugin_imports = require('./plugin-imports.js');
+
+var script = path.resolve(process.argv[2]);
+var plugins = process.argv.slice(3);
+
+// What the service expects of a worker
+global.require = require;
+global.__dirname = path.dirname(script);
+global.__filename = script;
+global.location = {pathname: '/js/' + path.basename(script)};
+global.performance = require('perf_hooks').performance;
+global.snapshot_build = true;
+
+function exported(name) {
+  return typeof Module['_' + name] !== 'undefined' ||
+         typeof global['_' + name] !== 'undefined';
+}
+
+function check() {
+  var failed = false;
+  plugins.forEach(function(file) {
+    var lib = path.basename(file).replace(/\.wasm$/, '');
+    var imports = plugin_imports(file);
+    var missing = imports.functions.concat(imports.data).filter(function(name) {
+      return !exported(name);
+    });
+    if (0 != missing.length) {
+      console.log(lib + ': not exported:', missing.join(' '));
+      failed = true;
+      return;
+    }
+    FS.writeFile('/' + lib + '.so', new Uint8Array(fs.readFileSync(file)));
+    var handle = ccallFunc(_dlopen, 'number', ['string', 'number'],
+                           ['/' + lib + '.so', 0]);
+    if (0 == handle) {
+      console.log(lib + ': dlopen failed');
+      failed = true;
+      return;
+    }
+    if (0 == ccallFunc(_dlsym, 'number', ['number', 'string'],
+                       [handle, lib + '_init'])) {
+      console.log(lib + ': no', lib + '_init');
+      failed = true;
+      return;
+    }
+    console.log(lib + ': ok,', imports.functions.length, 'functions and',
+                imports.data.length, 'data symbols imported');
+  });
+  process.exit(failed ? 1 : 0);
+}
+
+global.Module = {
+  preInit: [function() {
+    // Runs after pre.js's gnunet_prerun
+    random_bytes = new Uint8Array(4080);
+    random_offset = 0;
+    removeRunDependency('window-init');
+  }],
+  postRun: [check],
+  noInitialRun: true,
+};
+
+vm.runInThisContext(fs.readFileSync(script, 'utf8'), {filename: script});
+
+// vim: set expandtab ts=2 sw=2:
@@ -0,0 +1,208 @@
+// chk-worker-pre.js - linked into chk-worker, does CHK work for the page
+// Copyright (C) 2026  agent <agent@local>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Requests received before the runtime was up
+var chk_waiting = [];
+// Keys of the blocks we may be asked to decode, by query, each with the
+// number of times each download announced it (identical blocks share a
+// CHK) and when it was last announced.  Every worker is told every key but
+// only one decodes each block, so the page tells the others to forget the
+// key once it was used.  Keys of blocks that never arrive are dropped when
+// their download ends, or after CHK_KEY_TTL if it never does; the fs
+// library then decodes such a block itself.
+var chk_keys = new Map();
+// The queries each download announced, by download
+var chk_download_queries = new Map();
+var CHK_KEY_TTL = 10 * 60 * 1000;
+var CHK_SWEEP_INTERVAL = 60 * 1000;
+
+// Encode the block in data.data (an ArrayBuffer) and send back its key,
+// query and encrypted bytes tagged with data.id
+function chk_encode(data) {
+  var size = data.data.byteLength;
+  var pt = _malloc(size);
+  var out = _malloc(64 + 64 + size);
+  HEAPU8.set(new Uint8Array(data.data), pt);
+  _chk_encode(pt, size, out, out + 64, out + 128);
+  var key = HEAPU8.slice(out, out + 64);
+  var query = HEAPU8.slice(out + 64, out + 128);
+  var enc = HEAPU8.slice(out + 128, out + 128 + size);
+  _free(out);
+  _free(pt);
+  postMessage({
+    id: data.id,
+    key: key,
+    query: query,
+    enc: enc
+  }, [key.buffer, query.buffer, enc.buffer]);
+}
+
+function chk_string(bytes) {
+  return String.fromCharCode.apply(null, bytes);
+}
+
+// Remember the CHKs in data.chks, the contents of an IBlock of download
+// data.download, each a key followed by a query
+function chk_add_keys(data) {
+  var chks = data.chks;
+  var download = data.download;
+  var queries = chk_download_queries.get(download);
+  if (!queries) {
+    queries = new Set();
+    chk_download_queries.set(download, queries);
+  }
+  for (var i = 0; i + 128 <= chks.length; i += 128) {
+    var query = chk_string(chks.subarray(i + 64, i + 128));
+    var entry = chk_keys.get(query);
+    if (!entry) {
+      entry = {key: chks.slice(i, i + 64), owners: new Map()};
+      chk_keys.set(query, entry);
+    }
+    entry.owners.set(download, (entry.owners.get(download) || 0) + 1);
+    entry.announced = Date.now();
+    queries.add(query);
+  }
+}
+
+// Drop one announcement of the key of query, of any download
+function chk_use(query) {
+  var entry = chk_keys.get(query);
+  if (!entry) {
+    return;
+  }
+  var download = entry.owners.keys().next().value;
+  var count = entry.owners.get(download) - 1;
+  if (0 != count) {
+    entry.owners.set(download, count);
+    return;
+  }
+  entry.owners.delete(download);
+  if (0 == entry.owners.size) {
+    chk_keys.delete(query);
+  }
+}
+
+// Drop one announcement of the key of data.query, which another worker
+// used
+function chk_forget(data) {
+  chk_use(chk_string(data.query));
+}
+
+// Drop the keys download data.download announced, it ended
+function chk_forget_download(data) {
+  var queries = chk_download_queries.get(data.download);
+  if (!queries) {
+    return;
+  }
+  chk_download_queries.delete(data.download);
+  queries.forEach(function(query) {
+    var entry = chk_keys.get(query);
+    if (entry && entry.owners.delete(data.download) &&
+        0 == entry.owners.size) {
+      chk_keys.delete(query);
+    }
+  });
+}
+
+// Drop the keys nobody announced for CHK_KEY_TTL, their downloads are
+// stuck or gone without telling us
+function chk_sweep() {
+  var now = Date.now();
+  chk_keys.forEach(function(entry, query) {
+    if (now - entry.announced >= CHK_KEY_TTL) {
+      chk_keys.delete(query);
+    }
+  });
+  chk_download_queries.forEach(function(queries, download) {
+    queries.forEach(function(query) {
+      var entry = chk_keys.get(query);
+      if (!entry || !entry.owners.has(download)) {
+        queries.delete(query);
+      }
+    });
+    if (0 == queries.size) {
+      chk_download_queries.delete(download);
+    }
+  });
+}
+
+// Hash the encrypted block in data.data and, if its key was announced,
+// decrypt it.  Send back the query, whether the key was known and the
+// plaintext, or null if the key is unknown, tagged with data.id
+function chk_decode(data) {
+  var size = data.data.byteLength;
+  var enc = _malloc(size);
+  var out = _malloc(64 + 64 + size);
+  HEAPU8.set(new Uint8Array(data.data), enc);
+  _chk_query(enc, size, out);
+  var query = HEAPU8.slice(out, out + 64);
+  var entry = chk_keys.get(chk_string(query));
+  var pt = null;
+  if (entry) {
+    chk_use(chk_string(query));
+    HEAPU8.set(entry.key, out + 64);
+    if (size == _chk_decrypt(enc, size, out + 64, out + 128)) {
+      pt = HEAPU8.slice(out + 128, out + 128 + size);
+    }
+  }
+  _free(out);
+  _free(enc);
+  postMessage({
+    id: data.id,
+    query: query,
+    known: !!entry,
+    pt: pt
+  }, pt ? [query.buffer, pt.buffer] : [query.buffer]);
+}
+
+function chk_handle(data) {
+  switch (data.op) {
+    case 'encode':
+      chk_encode(data);
+      break;
+    case 'decode':
+      chk_decode(data);
+      break;
+    case 'keys':
+      chk_add_keys(data);
+      break;
+    case 'forget':
+      chk_forget(data);
+      break;
+    case 'forget-download':
+      chk_forget_download(data);
+      break;
+    default:
+      console.error('chk-worker: unknown request', data);
+  }
+}
+
+onmessage = function(e) {
+  if (runtimeInitialized) {
+    chk_handle(e.data);
+  } else {
+    chk_waiting.push(e.data);
+  }
+};
+
+if (typeof(Module['postRun']) === "undefined") Module['postRun'] = [];
+Module['postRun'].push(function() {
+  chk_waiting.forEach(chk_handle);
+  chk_waiting = [];
+  setInterval(chk_sweep, CHK_SWEEP_INTERVAL);
+});
+
+// vim: set expandtab ts=2 sw=2:
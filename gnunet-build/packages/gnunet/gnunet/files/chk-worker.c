@@ -0,0 +1,128 @@
+/*
+ * chk-worker.c - gnunet-web CHK encoder and decoder, one per worker
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "platform.h"
+#include "gnunet_util_lib.h"
+#include "emscripten.h"
+#include <gcrypt.h>
+
+int main(int argc, char **argv)
+{
+  GNUNET_log_setup("chk-worker", "ERROR", NULL);
+  emscripten_exit_with_live_runtime();
+}
+
+/**
+ * Encode one block the way fs_tree.c's encrypt_block() does, called by
+ * chk-worker-pre.js for each block the page sends.
+ *
+ * @param pt_block plaintext block
+ * @param pt_size size of @a pt_block
+ * @param key set to the hash of the plaintext
+ * @param query set to the hash of the encrypted block
+ * @param enc where to write the @a pt_size bytes of encrypted block
+ */
+void
+chk_encode (const void *pt_block,
+            size_t pt_size,
+            struct GNUNET_HashCode *key,
+            struct GNUNET_HashCode *query,
+            void *enc)
+{
+  struct GNUNET_CRYPTO_SymmetricSessionKey sk;
+  struct GNUNET_CRYPTO_SymmetricInitializationVector iv;
+
+  GNUNET_CRYPTO_hash (pt_block, pt_size, key);
+  GNUNET_CRYPTO_hash_to_aes_key (key, &sk, &iv);
+  GNUNET_CRYPTO_symmetric_encrypt (pt_block, pt_size, &sk, &iv, enc);
+  GNUNET_CRYPTO_hash (enc, pt_size, query);
+}
+
+/**
+ * Compute the query of an encrypted block, the way fs_download.c's
+ * handle_put() does.
+ *
+ * @param enc encrypted block
+ * @param size size of @a enc
+ * @param query set to the hash of @a enc
+ */
+void
+chk_query (const void *enc,
+           size_t size,
+           struct GNUNET_HashCode *query)
+{
+  GNUNET_CRYPTO_hash (enc, size, query);
+}
+
+/**
+ * Decrypt a block the way fs_download.c's process_result_with_request()
+ * does.
+ *
+ * @param enc encrypted block
+ * @param size size of @a enc
+ * @param key key of the block from its parent IBlock or the URI
+ * @param pt where to write the @a size bytes of plaintext
+ * @return @a size on success, -1 on error
+ */
+ssize_t
+chk_decrypt (const void *enc,
+             size_t size,
+             const struct GNUNET_HashCode *key,
+             void *pt)
+{
+  struct GNUNET_CRYPTO_SymmetricSessionKey sk;
+  struct GNUNET_CRYPTO_SymmetricInitializationVector iv;
+
+  GNUNET_CRYPTO_hash_to_aes_key (key, &sk, &iv);
+  return GNUNET_CRYPTO_symmetric_decrypt (enc, size, &sk, &iv, pt);
+}
+
+/**
+ * Encrypt a block in place with one of the two ciphers
+ * GNUNET_CRYPTO_symmetric_encrypt() chains, so sha512-test.js can time
+ * them apart.
+ *
+ * @param twofish 0 for AES-256, 1 for Twofish-256, both in CFB mode
+ * @param block the block to encrypt
+ * @param size size of @a block
+ * @return 0 on success, -1 on error
+ */
+int
+chk_cipher (int twofish,
+            void *block,
+            size_t size)
+{
+  static const unsigned char key[32];
+  static const unsigned char iv[16];
+  gcry_cipher_hd_t handle;
+  gcry_error_t rc;
+
+  if (0 != gcry_cipher_open (&handle,
+                             twofish ? GCRY_CIPHER_TWOFISH : GCRY_CIPHER_AES256,
+                             GCRY_CIPHER_MODE_CFB, 0))
+    return -1;
+  rc = gcry_cipher_setkey (handle, key, sizeof (key));
+  if (0 == rc)
+    rc = gcry_cipher_setiv (handle, iv, sizeof (iv));
+  if (0 == rc)
+    rc = gcry_cipher_encrypt (handle, block, size, NULL, 0);
+  gcry_cipher_close (handle);
+  return 0 == rc ? 0 : -1;
+}
+
+/* vim: set expandtab ts=2 sw=2: */
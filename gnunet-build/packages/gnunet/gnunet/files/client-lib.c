@@ -18,12 +18,187 @@
 
 #include "platform.h"
 #include "gnunet_fs_service.h"
+#include "gnunet_peerstore_service.h"
 #include "gnunet_transport_service.h"
 #include "emscripten.h"
 
+/* Size of a DBLOCK, see fs.h */
+#define CHK_BLOCK_SIZE (32 * 1024)
+
+/* The DBLOCK the page encoded in a chk-worker and is about to hand to the
+   tree encoder */
+static struct {
+  int valid;
+  uint64_t offset;
+  size_t size;
+  struct GNUNET_HashCode key;
+  struct GNUNET_HashCode query;
+  char enc[CHK_BLOCK_SIZE];
+} precomputed_chk;
+
+/**
+ * Set the CHK of the DBLOCK at @a offset, called by the page right before
+ * it passes the block to the reader's continuation.
+ *
+ * @param offset offset of the block in the file
+ * @param key hash of the plaintext
+ * @param query hash of the encrypted block
+ * @param enc encrypted block
+ * @param size size of the block
+ */
+void
+GNUNET_FS_precomputed_chk_set(double offset, const struct GNUNET_HashCode *key,
+    const struct GNUNET_HashCode *query, const void *enc, size_t size)
+{
+  if (size > CHK_BLOCK_SIZE) {
+    precomputed_chk.valid = 0;
+    return;
+  }
+  precomputed_chk.valid = 1;
+  precomputed_chk.offset = offset;
+  precomputed_chk.size = size;
+  precomputed_chk.key = *key;
+  precomputed_chk.query = *query;
+  memcpy(precomputed_chk.enc, enc, size);
+}
+
+static int
+precomputed_chk_get(uint64_t offset, const void *pt_block, uint16_t pt_size,
+    struct GNUNET_HashCode *key, struct GNUNET_HashCode *query, void *enc)
+{
+  if (!precomputed_chk.valid ||
+      precomputed_chk.offset != offset ||
+      precomputed_chk.size != pt_size)
+    return GNUNET_NO;
+  precomputed_chk.valid = 0;
+  *key = precomputed_chk.key;
+  *query = precomputed_chk.query;
+  memcpy(enc, precomputed_chk.enc, pt_size);
+  return GNUNET_OK;
+}
+
+/* Number of received blocks the page may have hashed and decrypted ahead
+   of the downloads, the oldest is forgotten first */
+#define PRECOMPUTED_BLOCKS 32
+
+/* A block a chk-worker hashed, and decrypted if the page knew its key,
+   before the page passed it on to the fs library */
+struct PrecomputedBlock {
+  size_t size;
+  int decrypted;
+  struct GNUNET_HashCode query;
+  char enc[CHK_BLOCK_SIZE];
+  char pt[CHK_BLOCK_SIZE];
+};
+static struct PrecomputedBlock precomputed_blocks[PRECOMPUTED_BLOCKS];
+static unsigned int precomputed_blocks_next;
+
+/* The blocks in precomputed_blocks by precomputed_fingerprint(), so a
+   block is found with one memcmp */
+static struct GNUNET_CONTAINER_MultiHashMap32 *precomputed_index;
+
+/* Encrypted blocks look random, so their first bytes tell them apart */
+static uint32_t
+precomputed_fingerprint(const void *block, size_t size)
+{
+  uint32_t fingerprint = 0;
+
+  memcpy(&fingerprint, block, GNUNET_MIN(size, sizeof fingerprint));
+  return fingerprint ^ size;
+}
+
+/**
+ * Add a block received for a download, called by the page right before
+ * it passes the message carrying it to the fs library.
+ *
+ * @param query hash of @a enc
+ * @param enc encrypted block
+ * @param pt decrypted block, or NULL if the page does not know its key
+ * @param size size of the block
+ */
+void
+GNUNET_FS_precomputed_block_add(const struct GNUNET_HashCode *query,
+    const void *enc, const void *pt, size_t size)
+{
+  unsigned int i = precomputed_blocks_next;
+
+  if (size > CHK_BLOCK_SIZE)
+    return;
+  precomputed_blocks_next = (i + 1) % PRECOMPUTED_BLOCKS;
+  if (0 != precomputed_blocks[i].size)
+    GNUNET_CONTAINER_multihashmap32_remove(precomputed_index,
+        precomputed_fingerprint(precomputed_blocks[i].enc,
+          precomputed_blocks[i].size), &precomputed_blocks[i]);
+  GNUNET_CONTAINER_multihashmap32_put(precomputed_index,
+      precomputed_fingerprint(enc, size), &precomputed_blocks[i],
+      GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE);
+  precomputed_blocks[i].size = size;
+  precomputed_blocks[i].query = *query;
+  memcpy(precomputed_blocks[i].enc, enc, size);
+  precomputed_blocks[i].decrypted = NULL != pt;
+  if (pt)
+    memcpy(precomputed_blocks[i].pt, pt, size);
+}
+
+/* What precomputed_query_get() is looking for */
+struct PrecomputedQueryContext {
+  const void *block;
+  size_t size;
+  const struct PrecomputedBlock *found;
+};
+
+static int
+precomputed_query_match(void *cls, uint32_t key, void *value)
+{
+  struct PrecomputedQueryContext *ctx = cls;
+  const struct PrecomputedBlock *b = value;
+
+  if (b->size != ctx->size ||
+      0 != memcmp(b->enc, ctx->block, ctx->size))
+    return GNUNET_YES;
+  ctx->found = b;
+  return GNUNET_NO;
+}
+
+static int
+precomputed_query_get(const void *block, size_t size,
+    struct GNUNET_HashCode *query)
+{
+  struct PrecomputedQueryContext ctx = {block, size, NULL};
+
+  GNUNET_CONTAINER_multihashmap32_get_multiple(precomputed_index,
+      precomputed_fingerprint(block, size), &precomputed_query_match, &ctx);
+  if (NULL == ctx.found)
+    return GNUNET_NO;
+  *query = ctx.found->query;
+  return GNUNET_OK;
+}
+
+static int
+precomputed_block_get(const struct GNUNET_HashCode *query, const void *block,
+    size_t size, void *pt)
+{
+  unsigned int i;
+
+  for (i = 0; i < PRECOMPUTED_BLOCKS; i++) {
+    if (precomputed_blocks[i].decrypted &&
+        precomputed_blocks[i].size == size &&
+        0 == GNUNET_CRYPTO_hash_cmp(&precomputed_blocks[i].query, query)) {
+      memcpy(pt, precomputed_blocks[i].pt, size);
+      return GNUNET_OK;
+    }
+  }
+  return GNUNET_NO;
+}
+
 int main(int argc, char **argv)
 {
   GNUNET_log_setup("client.js", "DEBUG", NULL);
+  precomputed_index =
+    GNUNET_CONTAINER_multihashmap32_create(PRECOMPUTED_BLOCKS);
+  GNUNET_FS_tree_encoder_precomputed = &precomputed_chk_get;
+  GNUNET_FS_download_precomputed_query = &precomputed_query_get;
+  GNUNET_FS_download_precomputed_block = &precomputed_block_get;
   emscripten_exit_with_live_runtime();
 }
 
@@ -59,6 +234,13 @@ GNUNET_FS_ProgressInfo_get_publish_completed_chk_uri(
   return pi->value.publish.specifics.completed.chk_uri;
 }
 
+const char *
+GNUNET_FS_ProgressInfo_get_publish_error_message(
+    struct GNUNET_FS_ProgressInfo *pi)
+{
+  return pi->value.publish.specifics.error.message;
+}
+
 void *
 GNUNET_FS_ProgressInfo_get_download_cctx(struct GNUNET_FS_ProgressInfo *pi)
 {
@@ -210,4 +392,68 @@ GNUNET_TRANSPORT_monitor_peers_simple(
       monitor_peers_callback, mpc);
 }
 
+struct watch_simple_cls {
+  struct GNUNET_PEERSTORE_WatchContext *wc;
+  void (*cb)(void *cls,
+      const void *value,
+      size_t value_size);
+  void *cb_cls;
+};
+
+static void
+watch_simple_callback(void *cls,
+    const struct GNUNET_PEERSTORE_Record *record,
+    const char *emsg)
+{
+  struct watch_simple_cls *wsc = cls;
+
+  if (!record)
+    return;
+  wsc->cb(wsc->cb_cls, record->value, record->value_size);
+}
+
+struct watch_simple_cls *
+GNUNET_PEERSTORE_watch_simple(struct GNUNET_PEERSTORE_Handle *h,
+    const char *sub_system,
+    const struct GNUNET_PeerIdentity *peer,
+    const char *key,
+    void *callback,
+    void *callback_cls)
+{
+  struct watch_simple_cls *wsc = malloc(sizeof(struct watch_simple_cls));
+
+  if (!wsc)
+    return NULL;
+  wsc->cb = callback;
+  wsc->cb_cls = callback_cls;
+  wsc->wc = GNUNET_PEERSTORE_watch(h, sub_system, peer, key,
+      watch_simple_callback, wsc);
+  return wsc;
+}
+
+void
+GNUNET_PEERSTORE_watch_cancel_simple(struct watch_simple_cls *wsc)
+{
+  GNUNET_PEERSTORE_watch_cancel(wsc->wc);
+  free(wsc);
+}
+
+struct GNUNET_PEERSTORE_StoreContext *
+GNUNET_PEERSTORE_store_simple(struct GNUNET_PEERSTORE_Handle *h,
+    const char *sub_system,
+    const struct GNUNET_PeerIdentity *peer,
+    const char *key,
+    const void *value,
+    size_t size,
+    double expiry,
+    void *cont,
+    void *cont_cls)
+{
+  struct GNUNET_TIME_Absolute abs;
+
+  abs.abs_value_us = expiry;
+  return GNUNET_PEERSTORE_store(h, sub_system, peer, key, value, size, abs,
+      GNUNET_PEERSTORE_STOREOPTION_REPLACE, cont, cont_cls);
+}
+
 /* vim: set expandtab ts=2 sw=2: */
@@ -51,4 +51,9 @@ function ccallFunc(func, returnType, argTypes, args) {
   return ret;
 }
 
+// Functions which wrap the receive function of new connections to a
+// service, by service name.  Each gets the function which queues data on
+// the socket and returns the one to call instead.
+var client_receive_filters = {};
+
 // vim: set expandtab ts=2 sw=2:
@@ -25,7 +25,10 @@ mergeInto(LibraryManager.library, {
     transport: {
       UNIXPATH: 'transport',
       NEIGHBOUR_LIMIT: 50,
-      PLUGINS: 'http_client webrtc',
+      PLUGINS: 'http_client websocket webrtc',
+    },
+    'transport-webrtc': {
+      SELECTIVE_RETRANSMIT: true,
     },
     ats: {
       UNIXPATH: 'ats',
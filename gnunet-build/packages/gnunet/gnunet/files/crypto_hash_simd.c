@@ -0,0 +1,339 @@
+/*
+ * crypto_hash_simd.c - gnunet-web GNUNET_CRYPTO_hash with WASM SIMD128
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "platform.h"
+#include "gnunet_util_lib.h"
+
+/**
+ * The libgcrypt based GNUNET_CRYPTO_hash() of crypto_hash.c, renamed by
+ * Buildrules.
+ */
+void
+GNUNET_CRYPTO_hash_gcrypt (const void *block,
+                           size_t size,
+                           struct GNUNET_HashCode *ret);
+
+#ifdef __wasm_simd128__
+
+/* Generic vectors, clang lowers them to SIMD128 instructions */
+typedef uint64_t u64x2 __attribute__ ((vector_size (16)));
+typedef uint8_t u8x16 __attribute__ ((vector_size (16)));
+
+#define SHA512_BLOCK 128
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (64 - (n))))
+#define BSIG0(x) (ROTR (x, 28) ^ ROTR (x, 34) ^ ROTR (x, 39))
+#define BSIG1(x) (ROTR (x, 14) ^ ROTR (x, 18) ^ ROTR (x, 41))
+#define SSIG0(x) (ROTR (x, 1) ^ ROTR (x, 8) ^ ((x) >> 7))
+#define SSIG1(x) (ROTR (x, 19) ^ ROTR (x, 61) ^ ((x) >> 6))
+#define CH(x, y, z) (((x) & (y)) ^ (~(x) & (z)))
+#define MAJ(x, y, z) (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+
+static const uint64_t K[80] __attribute__ ((aligned (16))) = {
+  0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL,
+  0xb5c0fbcfec4d3b2fULL, 0xe9b5dba58189dbbcULL,
+  0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL,
+  0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL,
+  0xd807aa98a3030242ULL, 0x12835b0145706fbeULL,
+  0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+  0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL,
+  0x9bdc06a725c71235ULL, 0xc19bf174cf692694ULL,
+  0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL,
+  0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL,
+  0x2de92c6f592b0275ULL, 0x4a7484aa6ea6e483ULL,
+  0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+  0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL,
+  0xb00327c898fb213fULL, 0xbf597fc7beef0ee4ULL,
+  0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL,
+  0x06ca6351e003826fULL, 0x142929670a0e6e70ULL,
+  0x27b70a8546d22ffcULL, 0x2e1b21385c26c926ULL,
+  0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+  0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL,
+  0x81c2c92e47edaee6ULL, 0x92722c851482353bULL,
+  0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL,
+  0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL,
+  0xd192e819d6ef5218ULL, 0xd69906245565a910ULL,
+  0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+  0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL,
+  0x2748774cdf8eeb99ULL, 0x34b0bcb5e19b48a8ULL,
+  0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL,
+  0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL,
+  0x748f82ee5defb2fcULL, 0x78a5636f43172f60ULL,
+  0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+  0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL,
+  0xbef9a3f7b2c67915ULL, 0xc67178f2e372532bULL,
+  0xca273eceea26619cULL, 0xd186b8c721c0c207ULL,
+  0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL,
+  0x06f067aa72176fbaULL, 0x0a637dc5a2c898a6ULL,
+  0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+  0x28db77f523047d84ULL, 0x32caab7b40c72493ULL,
+  0x3c9ebe0a15c9bebcULL, 0x431d67c49c100d4cULL,
+  0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL,
+  0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL,
+};
+
+static const uint64_t H0[8] = {
+  0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL,
+  0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+  0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL,
+  0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL,
+};
+
+/**
+ * SHA-512("abc"), checked once before the SIMD code is trusted.
+ */
+static const uint8_t abc_digest[64] = {
+  0xdd, 0xaf, 0x35, 0xa1, 0x93, 0x61, 0x7a, 0xba,
+  0xcc, 0x41, 0x73, 0x49, 0xae, 0x20, 0x41, 0x31,
+  0x12, 0xe6, 0xfa, 0x4e, 0x89, 0xa9, 0x7e, 0xa2,
+  0x0a, 0x9e, 0xee, 0xe6, 0x4b, 0x55, 0xd3, 0x9a,
+  0x21, 0x92, 0x99, 0x2a, 0x27, 0x4f, 0xc1, 0xa8,
+  0x36, 0xba, 0x3c, 0x23, 0xa3, 0xfe, 0xeb, 0xbd,
+  0x45, 0x4d, 0x44, 0x23, 0x64, 0x3c, 0xe8, 0x0e,
+  0x2a, 0x9a, 0xc9, 0x4f, 0xa5, 0x4c, 0xa4, 0x9f,
+};
+
+/**
+ * #GNUNET_YES once the self test passed, #GNUNET_NO if it failed,
+ * #GNUNET_SYSERR before it ran.
+ */
+static int simd_ok = GNUNET_SYSERR;
+
+
+/**
+ * Load two big-endian 64 bit words.
+ *
+ * @param p where to load them from, need not be aligned
+ * @return the words in host order
+ */
+static u64x2
+load_be64x2 (const uint8_t *p)
+{
+  u8x16 b;
+  u64x2 w;
+
+  memcpy (&b, p, sizeof (b));
+  b = __builtin_shufflevector (b, b,
+                               7, 6, 5, 4, 3, 2, 1, 0,
+                               15, 14, 13, 12, 11, 10, 9, 8);
+  memcpy (&w, &b, sizeof (w));
+  return w;
+}
+
+
+/**
+ * Run the SHA-512 compression function over whole blocks.  The message
+ * schedule, and adding the round constants to it, is computed two words
+ * at a time; the rounds themselves are inherently serial.
+ *
+ * @param state the eight state words
+ * @param data the blocks
+ * @param blocks number of 128 byte blocks at @a data
+ */
+static void
+sha512_blocks (uint64_t state[8],
+               const uint8_t *data,
+               size_t blocks)
+{
+  uint64_t W[80] __attribute__ ((aligned (16)));
+  uint64_t a, b, c, d, e, f, g, h, t1, t2;
+  u64x2 w2, w7, w15, w16, w, k;
+  unsigned int t;
+
+  for (; blocks > 0; blocks--, data += SHA512_BLOCK)
+  {
+    for (t = 0; t < 16; t += 2)
+    {
+      w = load_be64x2 (data + 8 * t);
+      memcpy (&W[t], &w, sizeof (w));
+    }
+    /* W[t] and W[t + 1] only depend on words before W[t] */
+    for (t = 16; t < 80; t += 2)
+    {
+      memcpy (&w2, &W[t - 2], sizeof (w2));
+      memcpy (&w7, &W[t - 7], sizeof (w7));
+      memcpy (&w15, &W[t - 15], sizeof (w15));
+      memcpy (&w16, &W[t - 16], sizeof (w16));
+      w = SSIG1 (w2) + w7 + SSIG0 (w15) + w16;
+      memcpy (&W[t], &w, sizeof (w));
+    }
+    for (t = 0; t < 80; t += 2)
+    {
+      memcpy (&w, &W[t], sizeof (w));
+      memcpy (&k, &K[t], sizeof (k));
+      w += k;
+      memcpy (&W[t], &w, sizeof (w));
+    }
+    a = state[0];
+    b = state[1];
+    c = state[2];
+    d = state[3];
+    e = state[4];
+    f = state[5];
+    g = state[6];
+    h = state[7];
+    for (t = 0; t < 80; t++)
+    {
+      t1 = h + BSIG1 (e) + CH (e, f, g) + W[t];
+      t2 = BSIG0 (a) + MAJ (a, b, c);
+      h = g;
+      g = f;
+      f = e;
+      e = d + t1;
+      d = c;
+      c = b;
+      b = a;
+      a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+  }
+}
+
+
+/**
+ * SHA-512 of a buffer.
+ *
+ * @param block the buffer
+ * @param size number of bytes in @a block
+ * @param digest where to write the 64 byte digest
+ */
+static void
+sha512 (const void *block,
+        size_t size,
+        uint8_t digest[64])
+{
+  uint64_t state[8];
+  uint8_t tail[2 * SHA512_BLOCK];
+  size_t full = size / SHA512_BLOCK;
+  size_t rest = size % SHA512_BLOCK;
+  size_t tail_size;
+  uint64_t bits = (uint64_t) size << 3;
+  unsigned int i;
+
+  memcpy (state, H0, sizeof (state));
+  sha512_blocks (state, block, full);
+  /* the rest, 0x80, zeros and the 128 bit length in bits */
+  tail_size = (rest < SHA512_BLOCK - 16) ? SHA512_BLOCK : 2 * SHA512_BLOCK;
+  memset (tail, 0, tail_size);
+  memcpy (tail, (const uint8_t *) block + full * SHA512_BLOCK, rest);
+  tail[rest] = 0x80;
+  for (i = 0; i < 8; i++)
+    tail[tail_size - 1 - i] = (uint8_t) (bits >> (8 * i));
+  tail[tail_size - 9] = (uint8_t) ((uint64_t) size >> 61);
+  sha512_blocks (state, tail, tail_size / SHA512_BLOCK);
+  for (i = 0; i < 64; i++)
+    digest[i] = (uint8_t) (state[i / 8] >> (56 - 8 * (i % 8)));
+}
+
+
+/**
+ * Check the SIMD code against a known answer and libgcrypt once.
+ *
+ * @return #GNUNET_YES if it can be used
+ */
+static int
+simd_self_test ()
+{
+  static const char fox[] = "The quick brown fox jumps over the lazy dog";
+  uint8_t digest[64];
+  struct GNUNET_HashCode expected;
+  char buf[3 * SHA512_BLOCK];
+  unsigned int i;
+
+  sha512 ("abc", 3, digest);
+  if (0 != memcmp (digest, abc_digest, sizeof (digest)))
+    return GNUNET_NO;
+  /* lengths around the block and padding boundaries */
+  for (i = 0; i < sizeof (buf); i++)
+    buf[i] = fox[i % (sizeof (fox) - 1)];
+  for (i = SHA512_BLOCK - 18; i < sizeof (buf); i += 7)
+  {
+    sha512 (buf, i, digest);
+    GNUNET_CRYPTO_hash_gcrypt (buf, i, &expected);
+    if (0 != memcmp (digest, &expected, sizeof (digest)))
+      return GNUNET_NO;
+  }
+  return GNUNET_YES;
+}
+
+#endif
+
+
+/**
+ * SHA-512 with the SIMD128 code alone, without its self test, for
+ * sha512-test.js to check and time it against libgcrypt.
+ *
+ * @param block the data to hash
+ * @param size the length of @a block
+ * @param ret pointer to where to write the hashcode
+ * @return #GNUNET_OK, #GNUNET_SYSERR if built without -msimd128
+ */
+int
+GNUNET_CRYPTO_hash_simd (const void *block,
+                         size_t size,
+                         struct GNUNET_HashCode *ret)
+{
+#ifdef __wasm_simd128__
+  sha512 (block, size, (uint8_t *) ret);
+  return GNUNET_OK;
+#else
+  return GNUNET_SYSERR;
+#endif
+}
+
+
+/**
+ * Hash block of given size.
+ *
+ * Uses the SIMD128 SHA-512 when built with -msimd128 and it passed its
+ * self test, libgcrypt otherwise.
+ *
+ * @param block the data to #GNUNET_CRYPTO_hash, or to encrypt
+ * @param size the length of the data to #GNUNET_CRYPTO_hash, or to encrypt
+ * @param ret pointer to where to write the hashcode
+ */
+void
+GNUNET_CRYPTO_hash (const void *block,
+                    size_t size,
+                    struct GNUNET_HashCode *ret)
+{
+#ifdef __wasm_simd128__
+  if (GNUNET_SYSERR == simd_ok)
+  {
+    simd_ok = simd_self_test ();
+    if (GNUNET_YES != simd_ok)
+      GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                  "SIMD SHA-512 failed its self test, using libgcrypt\n");
+  }
+  if (GNUNET_YES == simd_ok)
+  {
+    sha512 (block, size, (uint8_t *) ret);
+    return;
+  }
+#endif
+  GNUNET_CRYPTO_hash_gcrypt (block, size, ret);
+}
+
+/* vim: set expandtab ts=2 sw=2: */
@@ -0,0 +1,84 @@
+// make-snapshot.js - capture the heap of a service for snapshot-pre.js
+// Copyright (C) 2026  agent <agent@local>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Usage: node make-snapshot.js gnunet-service-foo.js
+//
+// Runs the service in node up to its main() and writes its heap to
+// gnunet-service-foo.snapshot.  The window never sends the private key,
+// and /dev/urandom returns zeros, so the snapshot holds no secrets; the
+// service mixes in fresh random bytes when it is restored.
+
+var fs = require('fs');
+var path = require('path');
+var vm = require('vm');
+
+var script = path.resolve(process.argv[2]);
+var output = script.replace(/\.js$/, '.snapshot');
+var base = 0;
+
+// What the service expects of a worker
+global.require = require;
+global.__dirname = path.dirname(script);
+global.__filename = script;
+global.location = {pathname: '/js/' + path.basename(script)};
+global.performance = require('perf_hooks').performance;
+global.snapshot_build = true;
+
+function capture() {
+  var top = HEAP32[DYNAMICTOP_PTR >> 2];
+  var fds = [];
+  FS.streams.forEach(function(stream, fd) {
+    if (stream && fd > 2) {
+      fds.push({
+        fd: fd,
+        path: stream.path,
+        flags: stream.flags,
+        position: stream.position});
+    }
+  });
+  var header = Buffer.from(JSON.stringify({
+    size: HEAP8.length,
+    base: base,
+    top: top,
+    fds: fds}));
+  var length = Buffer.alloc(4);
+  length.writeUInt32LE(header.length, 0);
+  fs.writeFileSync(output, Buffer.concat([
+    Buffer.from('gnsnap01'),
+    length,
+    header,
+    Buffer.from(HEAPU8.buffer, 0, top)]));
+  console.log(output + ':', top, 'bytes of heap,', fds.length, 'open files');
+  process.exit(0);
+}
+
+global.Module = {
+  preInit: [function() {
+    // Runs after pre.js's gnunet_prerun
+    random_bytes = new Uint8Array(4080);
+    random_offset = 0;
+    removeRunDependency('window-init');
+  }],
+  preRun: [function() {
+    base = HEAP32[DYNAMICTOP_PTR >> 2];
+  }],
+  postRun: [capture],
+  noInitialRun: true,
+};
+
+vm.runInThisContext(fs.readFileSync(script, 'utf8'), {filename: script});
+
+// vim: set expandtab ts=2 sw=2:
@@ -15,8 +15,70 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 mergeInto(LibraryManager.library, {
-  $SOCKETS: {incoming: []},
+  // Connected and bound sockets by descriptor, the descriptor listening on
+  // each path and connections waiting for a path to be listened on
+  $SOCKETS: {listeners: {}, pending: {}},
   $NEXT_SOCKET: 1,
+  // Messages and bytes sent and received, by the name of the other end,
+  // for pre.js to report
+  $SOCKET_STATS: {},
+  $socket_count__deps: ['$SOCKET_STATS'],
+  $socket_count: function(socket, direction, data) {
+    if ("string" == typeof data) {
+      return;
+    }
+    var stats = SOCKET_STATS[socket.name];
+    if (!stats) {
+      stats = SOCKET_STATS[socket.name] = {
+        sent: 0,
+        sent_bytes: 0,
+        received: 0,
+        received_bytes: 0,
+      };
+    }
+    stats[direction]++;
+    stats[direction + '_bytes'] += data.length;
+  },
+  // Call the read handler of a socket which has something to read
+  $socket_ready__deps: ['$SCHEDULER_TASKS', '$scheduler_call'],
+  $socket_ready: function(socket) {
+    if ("task" in socket) {
+      //console.debug("calling read handler");
+      delete SCHEDULER_TASKS[socket.task];
+      delete socket["task"];
+      scheduler_call(socket.handler, socket.cls);
+    }
+  },
+  // Call socket_ready in a fresh task.  A MessageChannel to ourselves
+  // avoids the clamping of nested setTimeout()s.
+  $socket_wake__deps: ['$SOCKETS', '$socket_ready'],
+  $socket_wake: function(socket) {
+    if (!SOCKETS.wake) {
+      SOCKETS.wake = {channel: new MessageChannel(), sockets: []};
+      SOCKETS.wake.channel.port1.onmessage = function() {
+        var sockets = SOCKETS.wake.sockets;
+        SOCKETS.wake.sockets = [];
+        sockets.forEach(socket_ready);
+      };
+    }
+    if (1 == SOCKETS.wake.sockets.push(socket)) {
+      SOCKETS.wake.channel.port2.postMessage(0);
+    }
+  },
+  // Queue a connection for the socket listening on data['service-name'];
+  // data.port is the remote end, or data.local the in-process one
+  $socket_incoming__deps: ['$SOCKETS', '$socket_ready'],
+  $socket_incoming: function(data) {
+    var path = data['service-name'];
+    if (path in SOCKETS.listeners) {
+      var listener = SOCKETS[SOCKETS.listeners[path]];
+      listener.incoming.push(data);
+      socket_ready(listener);
+    } else {
+      //console.debug("nobody listening on", path, "yet");
+      (SOCKETS.pending[path] = SOCKETS.pending[path] || []).push(data);
+    }
+  },
   GNUNET_NETWORK_socket_create__deps: ['$SOCKETS', '$NEXT_SOCKET'],
   GNUNET_NETWORK_socket_create: function(domain, type, protocol) {
     //console.debug("socket_create(", domain, type, protocol, ")");
@@ -31,7 +93,8 @@ mergeInto(LibraryManager.library, {
     }
     return NEXT_SOCKET++;
   },
-  GNUNET_NETWORK_socket_connect__deps: ['$SOCKETS'],
+  GNUNET_NETWORK_socket_connect__deps: ['$SOCKETS', '$socket_ready',
+                                        '$socket_incoming', '$socket_count'],
   GNUNET_NETWORK_socket_connect: function(desc, address, address_len) {
     //console.debug("socket_connect(", desc, address, address_len, ")");
     if (desc in SOCKETS) {
@@ -46,6 +109,20 @@ mergeInto(LibraryManager.library, {
     }
     var path = UTF8ToString(address + 2);
     //console.debug("connecting to", path);
+    if (typeof node_start == 'function' && node_start(path)) {
+      // the service runs in this worker, connect to it directly
+      var client = SOCKETS[desc] = {
+        name: path,
+        queue: [],
+      };
+      client.local = {
+        name: location.pathname,
+        queue: [],
+        local: client,
+      };
+      socket_incoming({'service-name': path, local: client.local});
+      return 1;
+    }
     var channel;
     try {
       channel = new MessageChannel();
@@ -59,15 +136,19 @@ mergeInto(LibraryManager.library, {
       name: path,
       queue: [],
     };
+    var receive = function(data) {
+      socket_count(socket, 'received', data);
+      socket.queue.push(data);
+      socket_ready(socket);
+    };
+    if (typeof client_receive_filters == 'object' &&
+        path in client_receive_filters) {
+      // the page looks at what the service sends before we read it
+      receive = client_receive_filters[path](receive);
+    }
     channel.port1.onmessage = function(ev) {
       //console.debug("got message on socket", desc, ev);
-      socket.queue.push(ev.data);
-      if ("task" in socket) {
-        //console.debug("calling read handler");
-        delete SCHEDULER_TASKS[socket.task];
-        delete socket["task"];
-        dynCall('vi', socket.handler, [socket.cls]);
-      }
+      receive(ev.data);
     };
     if (typeof client_connect == 'function') {
       client_connect(path, channel.port2);
@@ -82,7 +163,8 @@ mergeInto(LibraryManager.library, {
     }
     return 1;
   },
-  GNUNET_NETWORK_socket_send__deps: ['$SOCKETS'],
+  GNUNET_NETWORK_socket_send__deps: ['$SOCKETS', '$socket_wake',
+                                     '$socket_count'],
   GNUNET_NETWORK_socket_send: function(desc, buffer, length) {
     //console.debug("socket_send(", desc, buffer, length, ")");
     if (!(desc in SOCKETS)) {
@@ -90,8 +172,22 @@ mergeInto(LibraryManager.library, {
       ___setErrNo(ERRNO_CODES.ENOTCONN);
       return -1;
     }
+    var socket = SOCKETS[desc];
+    if ("local" in socket) {
+      if (!socket.local) {
+        ___setErrNo(ERRNO_CODES.ECONNRESET);
+        return -1;
+      }
+      var data = HEAPU8.slice(buffer, buffer + length);
+      socket_count(socket, 'sent', data);
+      socket_count(socket.local, 'received', data);
+      socket.local.queue.push(data);
+      socket_wake(socket.local);
+      return length;
+    }
     var view =
       new Uint8Array({{{ makeHEAPView('U8', 'buffer', 'buffer+length') }}});
+    socket_count(socket, 'sent', view);
     try {
       SOCKETS[desc].port.postMessage(new Uint8Array(view, [view]));
     } catch (e) {
@@ -101,7 +197,7 @@ mergeInto(LibraryManager.library, {
     }
     return length;
   },
-  GNUNET_NETWORK_socket_close__deps: ['$SOCKETS'],
+  GNUNET_NETWORK_socket_close__deps: ['$SOCKETS', '$socket_wake'],
   GNUNET_NETWORK_socket_close: function(desc) {
     //console.debug("socket_close(", desc, ")");
     if (!(desc in SOCKETS)) {
@@ -112,6 +208,14 @@ mergeInto(LibraryManager.library, {
       socket.port.postMessage("close");
       socket.port.close();
     }
+    if (socket.local) {
+      socket.local.queue.push("close");
+      socket.local.local = null;
+      socket_wake(socket.local);
+    }
+    if ("incoming" in socket) {
+      delete SOCKETS.listeners[socket.path];
+    }
     delete SOCKETS[desc];
     return 1;
   },
@@ -129,28 +233,39 @@ mergeInto(LibraryManager.library, {
     }
     var path = UTF8ToString(address + 2);
     //console.debug("binding to", path);
-    SOCKETS[desc] = {};
+    SOCKETS[desc] = {path: path};
     return 1;
   },
   GNUNET_NETWORK_socket_listen__deps: ['$SOCKETS'],
   GNUNET_NETWORK_socket_listen: function(desc, backlog) {
     //console.debug("socket_listen(", desc, backlog, ")");
-    if ("listening" in SOCKETS) {
-      console.error("only one listening socket is supported");
+    if (!(desc in SOCKETS)) {
+      console.error("socket is not bound");
+      ___setErrNo(ERRNO_CODES.EINVAL);
+      return -1;
+    }
+    var socket = SOCKETS[desc];
+    if (socket.path in SOCKETS.listeners) {
+      console.error("somebody is already listening on", socket.path);
+      ___setErrNo(ERRNO_CODES.EADDRINUSE);
       return -1;
     }
-    SOCKETS.listening = desc;
+    SOCKETS.listeners[socket.path] = desc;
+    socket.incoming = SOCKETS.pending[socket.path] || [];
+    delete SOCKETS.pending[socket.path];
     return 1;
   },
-  GNUNET_NETWORK_socket_accept__deps: ['$SOCKETS', '$NEXT_SOCKET'],
+  GNUNET_NETWORK_socket_accept__deps: ['$SOCKETS', '$NEXT_SOCKET',
+                                       '$socket_ready', '$socket_count'],
   GNUNET_NETWORK_socket_accept: function(desc, address, address_len) {
     //console.debug("socket_accept(", desc, address, address_len, ")");
-    if (desc != SOCKETS.listening) {
+    if (!(desc in SOCKETS) || !("incoming" in SOCKETS[desc])) {
       console.error("socket is not listening");
       ___setErrNo(ERRNO_CODES.EINVAL);
       return 0;
     }
-    if (0 == SOCKETS.incoming.length) {
+    var incoming = SOCKETS[desc].incoming;
+    if (0 == incoming.length) {
       //console.debug("no incoming connections");
       ___setErrNo(ERRNO_CODES.EWOULDBLOCK);
       return 0;
@@ -160,26 +275,33 @@ mergeInto(LibraryManager.library, {
       ___setErrNo(ERRNO_CODES.EINVAL);
       return 0;
     }
-    var data = SOCKETS.incoming.shift();
+    var data = incoming.shift();
     var sd = NEXT_SOCKET++;
-    var socket = SOCKETS[sd] = {
-      port: data.port,
-      name: data['client-name'],
-      queue: [],
-    };
-    data.port.onmessage = function(ev) {
-      //console.debug("got message on socket", sd, ev);
-      socket.queue.push(ev.data);
-      if ("task" in socket) {
-        //console.debug("calling read handler");
-        delete SCHEDULER_TASKS[socket.task];
-        delete socket["task"];
-        dynCall('vi', socket.handler, [socket.cls]);
-      }
-    };
+    var socket;
+    if (data.local) {
+      socket = SOCKETS[sd] = data.local;
+    } else {
+      socket = SOCKETS[sd] = {
+        port: data.port,
+        name: data['client-name'],
+        queue: [],
+      };
+      data.port.onmessage = function(ev) {
+        //console.debug("got message on socket", sd, ev);
+        socket_count(socket, 'received', ev.data);
+        socket.queue.push(ev.data);
+        socket_ready(socket);
+      };
+    }
     {{{ makeSetValue('address', '0', '1', 'i16') }}};
     stringToUTF8(socket.name, address + 2, 108);
     {{{ makeSetValue('address_len', '0', '110', 'i32') }}};
+    if (typeof startup_time !== 'undefined' && !SOCKETS.accepted) {
+      SOCKETS.accepted = true;
+      startup_stats.first_accept_ms = Date.now() - startup_time;
+      console.debug(location.pathname, 'accepted its first connection',
+                    startup_stats.first_accept_ms, 'ms after it started');
+    }
     return sd;
   },
   GNUNET_NETWORK_socket_recv__deps: ['$SOCKETS'],
@@ -217,11 +339,10 @@ mergeInto(LibraryManager.library, {
       // always ready to write
       return 1;
     }
-    if (desc == SOCKETS.listening) {
-      return SOCKETS.incoming.length;
-    }
     if (desc in SOCKETS) {
-      return SOCKETS[desc].queue.length;
+      var socket = SOCKETS[desc];
+      return ("incoming" in socket) ? socket.incoming.length
+                                    : socket.queue.length;
     }
     return 0;
   },
@@ -0,0 +1,77 @@
+// node-pre.js - linked into gnunet-node, all services in one worker
+// Copyright (C) 2026  agent <agent@local>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Services hosted here and whether they were started
+var node_services = {
+  ats: false,
+  cadet: false,
+  core: false,
+  datastore: false,
+  dht: false,
+  fs: false,
+  nse: false,
+  peerinfo: false,
+  peerstore: false,
+  topology: false,
+  transport: false,
+};
+// Services asked for before the runtime was up
+var node_waiting = [];
+
+function node_run(name) {
+  var start = Date.now();
+  try {
+    ccallFunc(_GNUNET_NODE_start_service, 'number', ['string'], [name]);
+  } catch (e) {
+    // GNUNET_SCHEDULER_run unwinds the stack once the service is set up.
+    // The service keeps using what it left there, so the stack must not be
+    // restored and this must not run while other C code is on the stack.
+    if ('unwind' !== e && 'SimulateInfiniteLoop' !== e) {
+      console.error('Failed to start', name, e);
+      return;
+    }
+  }
+  console.debug('started', name, 'in', Date.now() - start, 'ms, heap at',
+                HEAP32[DYNAMICTOP_PTR >> 2], 'bytes');
+}
+
+// Start a service unless it was started already.  The service starts in a
+// task of its own, connections to it wait until it listens.
+// Returns whether the service is hosted here.
+function node_start(name) {
+  if (!(name in node_services)) {
+    return false;
+  }
+  if (!node_services[name]) {
+    node_services[name] = true;
+    if (runtimeInitialized) {
+      setTimeout(node_run, 0, name);
+    } else {
+      node_waiting.push(name);
+    }
+  }
+  return true;
+}
+
+if (typeof(Module['postRun']) === "undefined") Module['postRun'] = [];
+Module['postRun'].push(function() {
+  node_waiting.forEach(function(name) {
+    setTimeout(node_run, 0, name);
+  });
+  node_waiting = [];
+});
+
+// vim: set expandtab ts=2 sw=2:
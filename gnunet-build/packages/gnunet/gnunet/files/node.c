@@ -0,0 +1,106 @@
+/*
+ * node.c - gnunet-web node, all services in one worker
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "platform.h"
+#include "gnunet_util_lib.h"
+#include "emscripten.h"
+
+/* The services' main()s, renamed when Buildrules compiles them for the
+   node */
+int gnunet_service_ats_main (int argc, char *const *argv);
+int gnunet_service_cadet_main (int argc, char *const *argv);
+int gnunet_service_core_main (int argc, char *const *argv);
+int gnunet_service_datastore_main (int argc, char *const *argv);
+int gnunet_service_dht_main (int argc, char *const *argv);
+int gnunet_service_fs_main (int argc, char *const *argv);
+int gnunet_service_nse_main (int argc, char *const *argv);
+int gnunet_service_peerinfo_main (int argc, char *const *argv);
+int gnunet_service_peerstore_main (int argc, char *const *argv);
+int gnunet_daemon_topology_main (int argc, char *const *argv);
+int gnunet_service_transport_main (int argc, char *const *argv);
+
+/**
+ * A service hosted by the node.
+ */
+struct NodeService
+{
+  /**
+   * Name of the service, also the path it listens on.
+   */
+  const char *name;
+
+  /**
+   * Name of the binary it is in outside of the node.
+   */
+  const char *binary;
+
+  /**
+   * Its main().
+   */
+  int (*main) (int argc, char *const *argv);
+};
+
+static const struct NodeService services[] = {
+  { "ats", "gnunet-service-ats", &gnunet_service_ats_main },
+  { "cadet", "gnunet-service-cadet", &gnunet_service_cadet_main },
+  { "core", "gnunet-service-core", &gnunet_service_core_main },
+  { "datastore", "gnunet-service-datastore", &gnunet_service_datastore_main },
+  { "dht", "gnunet-service-dht", &gnunet_service_dht_main },
+  { "fs", "gnunet-service-fs", &gnunet_service_fs_main },
+  { "nse", "gnunet-service-nse", &gnunet_service_nse_main },
+  { "peerinfo", "gnunet-service-peerinfo", &gnunet_service_peerinfo_main },
+  { "peerstore", "gnunet-service-peerstore", &gnunet_service_peerstore_main },
+  { "topology", "gnunet-daemon-topology", &gnunet_daemon_topology_main },
+  { "transport", "gnunet-service-transport", &gnunet_service_transport_main },
+  { NULL, NULL, NULL }
+};
+
+int main(int argc, char **argv)
+{
+  GNUNET_log_setup("gnunet-node", "ERROR", NULL);
+  emscripten_exit_with_live_runtime();
+}
+
+/**
+ * Start a service, called by node-pre.js from a fresh task.  The service
+ * sets itself up and GNUNET_SCHEDULER_run() unwinds the stack, so this
+ * only returns if the service is unknown.
+ *
+ * @param name name of the service
+ * @return #GNUNET_SYSERR if there is no such service
+ */
+int
+GNUNET_NODE_start_service (const char *name)
+{
+  const struct NodeService *service;
+  char *argv[4];
+
+  for (service = services; NULL != service->name; service++)
+  {
+    if (0 != strcmp (name, service->name))
+      continue;
+    argv[0] = (char *) service->binary;
+    argv[1] = "-L";
+    argv[2] = "ERROR";
+    argv[3] = NULL;
+    return service->main (3, argv);
+  }
+  return GNUNET_SYSERR;
+}
+
+/* vim: set expandtab ts=2 sw=2: */
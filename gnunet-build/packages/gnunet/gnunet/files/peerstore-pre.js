@@ -1,21 +1,143 @@
-peerstore_prerun = function() {
-  addRunDependency('peerstore-indexedDB');
-  var request = indexedDB.open('peerstore', 1);
+// Records live in the 'records' object store under a binary key:
+//   sub_system ‖ 0 ‖ peer (32 bytes) ‖ key ‖ 0 [‖ 1 ‖ value]
+// Replaced records use the bare prefix, multi-valued records append a 1 and
+// their value so distinct values, the empty one too, can coexist under the
+// same (sub_system, peer, key).  Any prefix of the key can be scanned with
+// peerstore_prefix_range().
+var peerstore_encoder = new TextEncoder();
+
+function peerstore_key(sub_system, peer, key, value) {
+  var parts = [peerstore_encoder.encode(sub_system), [0]];
+  if (peer) {
+    parts.push(peer);
+    if (null !== key) {
+      parts.push(peerstore_encoder.encode(key), [0]);
+      if (value) {
+        parts.push([1], value);
+      }
+    }
+  }
+  var length = parts.reduce(function(n, part) { return n + part.length; }, 0);
+  var buffer = new Uint8Array(length);
+  var offset = 0;
+  parts.forEach(function(part) {
+    buffer.set(part, offset);
+    offset += part.length;
+  });
+  return buffer.buffer;
+}
+
+// The smallest key greater than every key starting with prefix
+function peerstore_key_successor(prefix) {
+  var bytes = new Uint8Array(prefix.slice(0));
+  var i = bytes.length - 1;
+  while (i >= 0 && 0xff == bytes[i]) {
+    i--;
+  }
+  if (i < 0) {
+    return null;
+  }
+  bytes[i]++;
+  return bytes.buffer.slice(0, i + 1);
+}
+
+function peerstore_prefix_range(prefix) {
+  var upper = peerstore_key_successor(prefix);
+  if (null === upper) {
+    return IDBKeyRange.lowerBound(prefix);
+  }
+  return IDBKeyRange.bound(prefix, upper, false, true);
+}
+
+// Open a cursor on the records matching sub_system and, if not null, peer
+// and key
+function peerstore_lookup(store, sub_system, peer, key) {
+  if (!peer && key) {
+    return store.index('by_key').openCursor(
+        IDBKeyRange.only([sub_system, key]));
+  }
+  return store.openCursor(
+      peerstore_prefix_range(peerstore_key(sub_system, peer, key)));
+}
+
+// Open the peerstore database called name, creating or upgrading it, and
+// call callback with it or with null on error
+function peerstore_open(name, callback) {
+  var request = indexedDB.open(name, 3);
   request.onsuccess = function(e) {
-    self.psdb = e.target.result;
-    removeRunDependency('peerstore-indexedDB');
+    callback(e.target.result);
   };
   request.onerror = function(e) {
     console.error('Error opening peerstore database');
+    callback(null);
   };
   request.onupgradeneeded = function(e) {
     var db = e.target.result;
-    var store = db.createObjectStore('peerstore', {autoIncrement: true});
-    store.createIndex('by_subsystem', 'sub_system');
-    store.createIndex('by_pid', ['sub_system', 'peer']);
-    store.createIndex('by_key', ['sub_system', 'key']);
-    store.createIndex('by_all', ['sub_system', 'peer', 'key']);
-    store.createIndex('by_expiry', 'expiry');
+    var store;
+    if (e.oldVersion < 2) {
+      store = db.createObjectStore('records');
+      store.createIndex('by_key', ['sub_system', 'key']);
+      store.createIndex('by_expiry', 'expiry');
+    } else {
+      store = request.transaction.objectStore('records');
+    }
+    if (2 == e.oldVersion) {
+      // v2 appended the value of multi-valued records without the 1, so an
+      // empty value landed on the replaced record's key.  Rewrite them
+      // once the cursor is done, it would visit the new keys too.
+      var moves = [];
+      store.openCursor().onsuccess = function(e) {
+        var cursor = e.target.result;
+        if (cursor) {
+          var v = cursor.value;
+          var prefix = peerstore_key(v.sub_system, v.peer, v.key);
+          if (cursor.key.byteLength > prefix.byteLength) {
+            moves.push([cursor.key, v]);
+          }
+          cursor.continue();
+        } else {
+          moves.forEach(function(move) {
+            var v = move[1];
+            store.delete(move[0]);
+            store.put(v, peerstore_key(v.sub_system, v.peer, v.key, v.value));
+          });
+        }
+      };
+    }
+    if (1 == e.oldVersion) {
+      // v1 stored records under an auto-increment key with the peer as an
+      // array of signed bytes; rewrite them under the composite key
+      var old = request.transaction.objectStore('peerstore');
+      old.openCursor().onsuccess = function(e) {
+        var cursor = e.target.result;
+        if (cursor) {
+          var v = cursor.value;
+          var record = {
+            sub_system: v.sub_system,
+            peer: Uint8Array.from(v.peer),
+            key: v.key,
+            value: v.value,
+            expiry: v.expiry};
+          store.put(record, peerstore_key(record.sub_system, record.peer,
+                                          record.key, record.value));
+          cursor.continue();
+        } else {
+          db.deleteObjectStore('peerstore');
+        }
+      };
+    }
   };
+}
+
+peerstore_prerun = function() {
+  addRunDependency('peerstore-indexedDB');
+  peerstore_open('peerstore', function(db) {
+    if (db) {
+      self.psdb = db;
+      removeRunDependency('peerstore-indexedDB');
+    }
+  });
 };
 Module['preInit'].push(peerstore_prerun);
+
+// vim: set expandtab ts=2 sw=2:
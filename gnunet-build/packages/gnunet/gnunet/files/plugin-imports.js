@@ -0,0 +1,57 @@
+// plugin-imports.js - list the functions wasm plugins import
+// Copyright (C) 2026  agent <agent@local>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Usage: node plugin-imports.js libgnunet_plugin_foo.wasm...
+//
+// Prints the functions the side modules import from the main module, one
+// "_name" per line, for EXPORTED_FUNCTIONS.  Those are the env function
+// imports and the GOT.func entries of functions whose address is taken.
+// __memory_base, __table_base, the memory, the table and the GOT.mem
+// entries of data symbols are not functions and are left out.
+
+var fs = require('fs');
+
+// The imports of the side module in file, {functions, data}
+function plugin_imports(file) {
+  var module = new WebAssembly.Module(fs.readFileSync(file));
+  var functions = [];
+  var data = [];
+  WebAssembly.Module.imports(module).forEach(function(i) {
+    if (('env' == i.module && 'function' == i.kind) ||
+        'GOT.func' == i.module) {
+      functions.push(i.name);
+    } else if ('GOT.mem' == i.module) {
+      data.push(i.name);
+    }
+  });
+  return {functions: functions, data: data};
+}
+
+module.exports = plugin_imports;
+
+if (require.main === module) {
+  var names = {};
+  process.argv.slice(2).forEach(function(file) {
+    plugin_imports(file).functions.forEach(function(name) {
+      names['"_' + name + '"'] = true;
+    });
+  });
+  Object.keys(names).sort().forEach(function(name) {
+    console.log(name);
+  });
+}
+
+// vim: set expandtab ts=2 sw=2:
@@ -15,12 +15,65 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 mergeInto(LibraryManager.library, {
-  GNUNET_PLUGIN_load__deps: ['dlclose', 'dlsym', 'dlopen'],
+  // Plugins are kept in the FS under PLUGIN_SUFFIX and fetched from next
+  // to the service under PLUGIN_URL_SUFFIX.  wasm plugins are .so in the
+  // FS so dlopen() treats them as side modules.
+#if WASM
+  $PLUGIN_SUFFIX: '".so"',
+  $PLUGIN_URL_SUFFIX: '".wasm"',
+#else
+  $PLUGIN_SUFFIX: '".js"',
+  $PLUGIN_URL_SUFFIX: '".js"',
+#endif
+  // Plugins fetched so far, and their bytes and time taken
+  $PLUGIN_STATS: {count: 0, bytes: 0, ms: 0},
+  // Fetch a plugin into the FS unless it is there already.  Only plugins
+  // in this service's manifest, generated by Buildrules, are fetched.
+  // Workers may use synchronous XHRs, and may compile wasm synchronously.
+  $plugin_fetch__deps: ['$FS', '$PLUGIN_SUFFIX', '$PLUGIN_URL_SUFFIX',
+                        '$PLUGIN_STATS'],
+  $plugin_fetch: function(lib) {
+    var path = '/' + lib + PLUGIN_SUFFIX;
+    if (FS.analyzePath(path).exists) {
+      return true;
+    }
+    if (typeof plugin_manifest === 'undefined' ||
+        plugin_manifest.indexOf(lib) < 0) {
+      return false;
+    }
+    var start = Date.now();
+    var xhr = new XMLHttpRequest();
+    try {
+      xhr.open('GET', lib + PLUGIN_URL_SUFFIX, false);
+      xhr.responseType = 'arraybuffer';
+      xhr.send(null);
+    } catch (e) {
+      console.error('Failed to fetch plugin', lib, e);
+      return false;
+    }
+    if (200 != xhr.status || !xhr.response) {
+      console.error('Failed to fetch plugin', lib, xhr.status);
+      return false;
+    }
+    FS.writeFile(path, new Uint8Array(xhr.response));
+    PLUGIN_STATS.count++;
+    PLUGIN_STATS.bytes += xhr.response.byteLength;
+    PLUGIN_STATS.ms += Date.now() - start;
+    console.debug('fetched', lib, xhr.response.byteLength, 'bytes in',
+                  Date.now() - start, 'ms,', PLUGIN_STATS.count, 'plugins',
+                  PLUGIN_STATS.bytes, 'bytes', PLUGIN_STATS.ms, 'ms so far');
+    return true;
+  },
+  GNUNET_PLUGIN_load__deps: ['dlclose', 'dlsym', 'dlopen', '$PLUGIN_SUFFIX',
+                             '$plugin_fetch'],
   GNUNET_PLUGIN_load: function(library_name, arg) {
     var lib = UTF8ToString(library_name);
+    if (!plugin_fetch(lib)) {
+      return 0;
+    }
     var handle = ccallFunc(_dlopen, 'number',
       ['string', 'number'],
-      [lib + '.js', 0]);
+      [lib + PLUGIN_SUFFIX, 0]);
     if (0 == handle) {
       return 0;
     }
@@ -38,20 +91,15 @@ mergeInto(LibraryManager.library, {
     }
     return ret;
   },
-  GNUNET_PLUGIN_load_all__deps: ['$FS', 'GNUNET_PLUGIN_load'],
+  GNUNET_PLUGIN_load_all__deps: ['GNUNET_PLUGIN_load'],
   GNUNET_PLUGIN_load_all: function(basename, arg, cb, cb_cls) {
     var prefix = UTF8ToString(basename);
-    var entries = [];
-    try {
-      entries = FS.readdir('.');
-    } catch (e) {
+    if (typeof plugin_manifest === 'undefined') {
       return;
     }
-    entries.map(function(entry) {
+    plugin_manifest.forEach(function(entry) {
       if (entry.lastIndexOf(prefix, 0) !== 0)
         return;
-      // Remove .js suffix
-      entry = entry.substr(0, entry.length - 3);
       var rc = ccallFunc(_GNUNET_PLUGIN_load, 'number',
           ['string', 'number'],
           [entry, arg]);
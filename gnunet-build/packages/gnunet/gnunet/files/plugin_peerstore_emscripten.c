@@ -50,9 +50,64 @@ struct Plugin
   const struct GNUNET_CONFIGURATION_Handle *cfg;
 };
 
+/**
+ * State of one call to #peerstore_emscripten_expire_records().
+ */
+struct ExpireContext
+{
+  /**
+   * Continuation called with the number of records expired
+   */
+  GNUNET_PEERSTORE_Continuation cont;
+
+  /**
+   * Closure for @e cont
+   */
+  void *cont_cls;
+
+  /**
+   * When the request was made
+   */
+  struct GNUNET_TIME_Absolute start;
+};
+
+/**
+ * Called from js once the expiry sweep covering this request has finished.
+ *
+ * @param ctx the request
+ * @param removed number of records removed by the sweep
+ * @param failed non-zero if a batch of the sweep failed
+ */
+static void
+peerstore_emscripten_expire_done (struct ExpireContext *ctx,
+    int removed,
+    int failed)
+{
+  struct GNUNET_TIME_Relative duration;
+
+  duration = GNUNET_TIME_absolute_get_duration (ctx->start);
+  if (failed)
+    LOG (GNUNET_ERROR_TYPE_WARNING,
+         "Expiry sweep failed after removing %d records in %s\n",
+         removed,
+         GNUNET_STRINGS_relative_time_to_string (duration, GNUNET_YES));
+  else
+    LOG (GNUNET_ERROR_TYPE_DEBUG,
+         "Expiry sweep removed %d records in %s\n",
+         removed,
+         GNUNET_STRINGS_relative_time_to_string (duration, GNUNET_YES));
+  if (NULL != ctx->cont)
+    ctx->cont (ctx->cont_cls, failed ? GNUNET_SYSERR : removed);
+  GNUNET_free (ctx);
+}
+
 /**
  * Delete expired records (expiry < now)
  *
+ * The records are removed by a background sweep in bounded batches, one
+ * transaction per scheduler turn.  If a sweep is already running this
+ * request joins it.
+ *
  * @param cls closure (internal context for the plugin)
  * @param now time to use as reference
  * @param cont continuation called with the number of records expired
@@ -66,10 +121,16 @@ peerstore_emscripten_expire_records(void *cls,
     GNUNET_PEERSTORE_Continuation cont,
     void *cont_cls)
 {
-  extern void peerstore_emscripten_expire_records_int(double now, void *cont,
-      void *cont_cls);
+  extern void peerstore_emscripten_expire_records_int(double now, void *done,
+      void *ctx);
+  struct ExpireContext *ctx;
 
-  peerstore_emscripten_expire_records_int(now.abs_value_us, cont, cont_cls);
+  ctx = GNUNET_new (struct ExpireContext);
+  ctx->cont = cont;
+  ctx->cont_cls = cont_cls;
+  ctx->start = GNUNET_TIME_absolute_get ();
+  peerstore_emscripten_expire_records_int(now.abs_value_us,
+      &peerstore_emscripten_expire_done, ctx);
   return GNUNET_OK;
 }
 
@@ -93,7 +154,7 @@ peerstore_emscripten_iter_wrapper (
   ret.key = key;
   ret.value = value;
   ret.value_size = value_size;
-  ret.expiry.abs_value_us = expiry;
+  ret.expiry.abs_value_us = *expiry;
   iter (iter_cls, &ret, NULL);
 }
 
@@ -162,6 +223,28 @@ peerstore_emscripten_store_record(void *cls,
 }
 
 
+/**
+ * Call @a notify with each record once its store, replace or expiry has
+ * been committed.  Expired records keep their expiry, which is in the
+ * past.
+ *
+ * @param cls closure (internal context for the plugin)
+ * @param notify function to call with each changed record
+ * @param notify_cls closure for @a notify
+ */
+static void
+peerstore_emscripten_set_notify (void *cls,
+    GNUNET_PEERSTORE_Processor notify,
+    void *notify_cls)
+{
+  extern void peerstore_emscripten_set_notify_int(void *notify,
+      void *notify_cls, void *wrapper);
+
+  peerstore_emscripten_set_notify_int(notify, notify_cls,
+      &peerstore_emscripten_iter_wrapper);
+}
+
+
 /**
  * Entry point for the plugin.
  *
@@ -184,6 +267,7 @@ libgnunet_plugin_peerstore_emscripten_init (void *cls)
   api->store_record = &peerstore_emscripten_store_record;
   api->iterate_records = &peerstore_emscripten_iterate_records;
   api->expire_records = &peerstore_emscripten_expire_records;
+  api->set_notify = &peerstore_emscripten_set_notify;
   LOG(GNUNET_ERROR_TYPE_DEBUG, "emscripten plugin is running\n");
   return api;
 }
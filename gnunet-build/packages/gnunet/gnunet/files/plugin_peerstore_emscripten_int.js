@@ -15,74 +15,114 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 mergeInto(LibraryManager.library, {
-  peerstore_emscripten_expire_records_int: function(now, cont, cont_cls) {
-    var count = 0;
-    var store =
-     self.psdb.transaction(['peerstore'], 'readwrite').objectStore('peerstore');
-    var request = store.index('by_expiry').openCursor(
-        IDBKeyRange.upperBound(now, true));
-    request.onsuccess = function(e) {
-      var cursor = e.target.result;
-      if (cursor) {
-        count++;
-        cursor.delete().onerror = function(e) {
-          console.error('expiry request failed');
-        };
-        cursor.continue();
-      } else {
-        if (cont) {
-          dynCall('vii', cont, [cont_cls, count]);
-        }
-      }
+  $PEERSTORE_SWEEP: null,
+  // The service's watch notifier, see peerstore_emscripten_set_notify
+  $PEERSTORE_NOTIFY: null,
+  // Call the GNUNET_PEERSTORE_Processor iter through wrapper with record
+  $peerstore_call_processor: function(wrapper, iter, iter_cls, record) {
+    var stack = stackSave();
+    var expiry = stackAlloc(getNativeTypeSize("double"));
+    setValue(expiry, record.expiry, "double");
+    ccallFunc(
+        getFuncWrapper(wrapper, "viiiiiiii"),
+        "void",
+        ["number", "number", "string", "array", "string", "array", "number",
+         "number"],
+        [iter, iter_cls, record.sub_system, record.peer, record.key,
+         record.value, record.value.length, expiry]);
+    stackRestore(stack);
+  },
+  // Tell the service's watchers about records whose change was committed
+  $peerstore_notify__deps: ['$PEERSTORE_NOTIFY', '$peerstore_call_processor'],
+  $peerstore_notify: function(records) {
+    if (!PEERSTORE_NOTIFY) {
+      return;
+    }
+    records.forEach(function(record) {
+      peerstore_call_processor(PEERSTORE_NOTIFY.wrapper,
+                               PEERSTORE_NOTIFY.notify,
+                               PEERSTORE_NOTIFY.cls, record);
+    });
+  },
+  peerstore_emscripten_set_notify_int__deps: ['$PEERSTORE_NOTIFY'],
+  peerstore_emscripten_set_notify_int: function(notify, notify_cls, wrapper) {
+    PEERSTORE_NOTIFY = {notify: notify, cls: notify_cls, wrapper: wrapper};
+  },
+  peerstore_emscripten_expire_records_int__deps: ['$PEERSTORE_SWEEP',
+                                                  '$PEERSTORE_NOTIFY',
+                                                  '$peerstore_notify'],
+  peerstore_emscripten_expire_records_int: function(now, done, ctx) {
+    if (PEERSTORE_SWEEP) {
+      PEERSTORE_SWEEP.waiters.push([done, ctx]);
+      return;
+    }
+    // Expired records are not contiguous in the primary key space, so each
+    // batch fetches a bounded number of expired keys from the by_expiry
+    // index and deletes them in one transaction, yielding between batches
+    var batch_size = 128;
+    var sweep = PEERSTORE_SWEEP = {
+      removed: 0,
+      failed: false,
+      waiters: [[done, ctx]]};
+    var finish = function() {
+      PEERSTORE_SWEEP = null;
+      sweep.waiters.forEach(function(waiter) {
+        dynCall('viii', waiter[0],
+                [waiter[1], sweep.removed, sweep.failed ? 1 : 0]);
+      });
     };
-    request.onerror = function(e) {
-      console.error('cursor request failed');
-      dynCall('vii', cont, [cont_cls, -1]);
+    var batch = function() {
+      var transaction = self.psdb.transaction(['records'], 'readwrite');
+      var store = transaction.objectStore('records');
+      var count = 0;
+      var index = store.index('by_expiry');
+      var range = IDBKeyRange.upperBound(now, true);
+      // The watchers get the expired records too; both requests walk the
+      // index in the same order, so the values match the keys
+      var values = PEERSTORE_NOTIFY ? index.getAll(range, batch_size) : null;
+      var request = index.getAllKeys(range, batch_size);
+      request.onsuccess = function(e) {
+        var keys = e.target.result;
+        count = keys.length;
+        keys.forEach(function(key) {
+          store.delete(key);
+        });
+      };
+      transaction.oncomplete = function(e) {
+        sweep.removed += count;
+        if (values) {
+          peerstore_notify(values.result);
+        }
+        if (count < batch_size) {
+          finish();
+        } else {
+          setTimeout(batch, 0);
+        }
+      };
+      transaction.onabort = function(e) {
+        console.error('expiry batch failed after removing', sweep.removed,
+                      'records');
+        sweep.failed = true;
+        finish();
+      };
     };
-  }, 
+    batch();
+  },
+  peerstore_emscripten_iterate_records_int__deps: ['$peerstore_call_processor'],
   peerstore_emscripten_iterate_records_int: function(sub_system_pointer,
                                                 peer_pointer, key_pointer,
                                                 iter, iter_cls, wrapper) {
     var sub_system = UTF8ToString(sub_system_pointer);
-    var peer = peer_pointer ? Array.prototype.slice.call(
-        HEAP8.subarray(peer_pointer, peer_pointer + 32))
-      : null;
+    var peer = peer_pointer ?
+      HEAPU8.slice(peer_pointer, peer_pointer + 32) : null;
     var key = key_pointer ? UTF8ToString(key_pointer) : null;
-    var key_range = [sub_system];
-    if (peer) {
-      key_range.push(peer);
-    }
-    if (key) {
-      key_range.push(key);
-    }
     var store =
-      self.psdb.transaction(['peerstore'], 'readonly').objectStore('peerstore');
-    var index;
-    if (!peer && !key) {
-      index = store.index('by_subsystem');
-    } else if (!peer) {
-      index = store.index('by_key');
-    } else if (!key) {
-      index = store.index('by_peer');
-    } else {
-      index = store.index('by_all');
-    }
-    var request = index.openCursor(IDBKeyRange.only(key_range));
+      self.psdb.transaction(['records'], 'readonly').objectStore('records');
+    var request = peerstore_lookup(store, sub_system, peer, key);
     request.onsuccess = function(e) {
       var cursor = e.target.result;
       if (cursor) {
-        var stack = stackSave();
-        var expiry = stackAlloc(getNativeTypeSize("double"));
-        setValue(expiry, cursor.value.expiry, "double");
-        ccallFunc(
-            getFuncWrapper(wrapper, "viiiiiiii"),
-            "void",
-            ["number", "number", "string", "array", "string", "array", "number",
-             "number"],
-            [iter, iter_cls, cursor.value.subsystem, cursor.value.peer,
-             cursor.value.key, cursor.value.value, cursor.value.value.length,
-             expiry]);
-        stackRestore(stack);
+        peerstore_call_processor(wrapper, iter, iter_cls, cursor.value);
         cursor.continue();
       } else {
         dynCall('viii', iter, [iter_cls, 0, 0]);
@@ -93,54 +133,38 @@ mergeInto(LibraryManager.library, {
       dynCall('viii', iter, [iter_cls, 0, -1]);
     };
   },
+  peerstore_emscripten_store_record_int__deps: ['$peerstore_notify'],
   peerstore_emscripten_store_record_int: function(sub_system_pointer,
                                              peer_pointer, key_pointer,
                                              value_pointer, size, expiry,
                                              options, cont, cont_cls) {
-    var sub_system = UTF8ToString(sub_system_pointer);
-    var peer = Array.prototype.slice.call(HEAP8.subarray(peer_pointer,
-          peer_pointer + 32));
-    var key = UTF8ToString(key_pointer);
-    var value = new Uint8Array(HEAP8.subarray(value_pointer,
-          value_pointer + size));
-    var store =
-     self.psdb.transaction(['peerstore'], 'readwrite').objectStore('peerstore');
-    var put = function() {
-      var request = store.put(
-          {sub_system: sub_system,
-           peer: peer,
-           key: key,
-           value: value,
-           expiry: expiry});
-      request.onerror = function(e) {
-        console.error('put request failed');
-        dynCall('vii', cont, [cont_cls, -1]);
-      };
-      request.onsuccess = function(e) {
-        dynCall('vii', cont, [cont_cls, 1]);
-      };
-    };
+    var record = {
+      sub_system: UTF8ToString(sub_system_pointer),
+      peer: HEAPU8.slice(peer_pointer, peer_pointer + 32),
+      key: UTF8ToString(key_pointer),
+      value: HEAPU8.slice(value_pointer, value_pointer + size),
+      expiry: expiry};
+    var transaction = self.psdb.transaction(['records'], 'readwrite');
+    var store = transaction.objectStore('records');
     if (options == 1) {
-      var request = store.index('by_all').openCursor(
-          IDBKeyRange.only([sub_system, peer, key]));
-      request.onsuccess = function(e) {
-        var cursor = e.target.result;
-        if (cursor) {
-          cursor.delete().onerror = function(e) {
-            console.error('replace request failed');
-          };
-          cursor.continue();
-        } else {
-          put();
-        }
-      };
-      request.onerror = function(e) {
-        console.error('cursor request failed');
-        dynCall('vii', cont, [cont_cls, -1]);
-      };
+      // GNUNET_PEERSTORE_STOREOPTION_REPLACE: overwrite the single-valued
+      // slot and drop any multi-valued records sharing its prefix
+      var prefix = peerstore_key(record.sub_system, record.peer, record.key);
+      var upper = peerstore_key_successor(prefix);
+      store.delete(IDBKeyRange.bound(prefix, upper, true, true));
+      store.put(record, prefix);
     } else {
-      put();
+      store.put(record, peerstore_key(record.sub_system, record.peer,
+                                      record.key, record.value));
     }
+    transaction.oncomplete = function(e) {
+      peerstore_notify([record]);
+      dynCall('vii', cont, [cont_cls, 1]);
+    };
+    transaction.onabort = function(e) {
+      console.error('store transaction failed');
+      dynCall('vii', cont, [cont_cls, -1]);
+    };
   }
 });
 
@@ -40,6 +40,50 @@
 
 #define PUT_DISCONNECT_TIMEOUT GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 1)
 
+/**
+ * How long to wait for more messages before sending a PUT.
+ */
+#define PUT_COALESCE_DELAY GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS, 5)
+
+/**
+ * Largest PUT body we build from queued messages.
+ */
+#define PUT_MAX_SIZE (64 * 1024)
+
+/**
+ * Estimated framing per PUT: request line, browser request headers and
+ * the response.  Scripts can't see the real header sizes.
+ */
+#define PUT_FRAMING_SIZE 256
+
+/**
+ * Default for the GETs we keep open to one origin.  Browsers allow six
+ * HTTP/1.1 connections per origin, the rest are left for PUTs.
+ */
+#define DEFAULT_MAX_CONNECTIONS_PER_ORIGIN 4
+
+/**
+ * How long we stay away from a URL after its first failure; doubled on
+ * every further failure up to #FAILURE_BACKOFF_MAX.
+ */
+#define FAILURE_BACKOFF_MIN GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 5)
+
+/**
+ * Longest we stay away from a failing URL.
+ */
+#define FAILURE_BACKOFF_MAX GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MINUTES, 30)
+
+/**
+ * Forget about a failed URL this long after we may retry it.
+ */
+#define FAILURE_CACHE_TTL GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_HOURS, 1)
+
+/**
+ * How often we drop the URLs that are past #FAILURE_CACHE_TTL from the
+ * failure cache.
+ */
+#define FAILURE_SWEEP_INTERVAL GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MINUTES, 10)
+
 #define ENABLE_PUT GNUNET_YES
 #define ENABLE_GET GNUNET_YES
 
@@ -102,6 +146,116 @@ struct HTTP_Message
 };
 
 
+/**
+ * A PUT in flight, carrying the messages it was built from.
+ */
+struct HTTP_Put
+{
+  /**
+   * Session the PUT was sent for, NULL once the session is gone.
+   */
+  struct GNUNET_ATS_Session *s;
+
+  /**
+   * Peer the messages are addressed to.
+   */
+  struct GNUNET_PeerIdentity target;
+
+  /**
+   * head of messages in this PUT
+   */
+  struct HTTP_Message *msg_head;
+
+  /**
+   * tail of messages in this PUT
+   */
+  struct HTTP_Message *msg_tail;
+};
+
+
+/**
+ * Sessions to one origin (scheme, host and port).  Browsers limit the
+ * connections per origin and each GET holds one for as long as the
+ * session lives, so we limit the GETs per origin.
+ */
+struct HTTP_Origin
+{
+  /**
+   * Pointer to the global plugin struct.
+   */
+  struct HTTP_Client_Plugin *plugin;
+
+  /**
+   * scheme://host:port
+   */
+  char *name;
+
+  /**
+   * Key in the plugin's origins map.
+   */
+  struct GNUNET_HashCode key;
+
+  /**
+   * head of sessions with their GET open
+   */
+  struct GNUNET_ATS_Session *active_head;
+
+  /**
+   * tail of sessions with their GET open
+   */
+  struct GNUNET_ATS_Session *active_tail;
+
+  /**
+   * head of sessions waiting to open their GET, those ATS selected first
+   */
+  struct GNUNET_ATS_Session *waiting_head;
+
+  /**
+   * tail of sessions waiting to open their GET
+   */
+  struct GNUNET_ATS_Session *waiting_tail;
+
+  /**
+   * Number of sessions to this origin.
+   */
+  unsigned int sessions;
+
+  /**
+   * Number of sessions in the @e active_head list.
+   */
+  unsigned int gets;
+
+  /**
+   * #GNUNET_YES once the browser used HTTP/2 or later with this origin.
+   * All requests then share one connection and only the plugin wide
+   * limit applies.
+   */
+  int multiplexed;
+};
+
+
+/**
+ * A URL whose requests failed, in the negative cache.
+ */
+struct HTTP_Failure
+{
+  /**
+   * Key in the plugin's failures map, hash of the URL.
+   */
+  struct GNUNET_HashCode key;
+
+  /**
+   * Don't open sessions to the URL before this time.
+   */
+  struct GNUNET_TIME_Absolute retry;
+
+  /**
+   * Failures since the last success.
+   */
+  unsigned int failures;
+};
+
+
 /**
  * Session handle for connections.
  */
@@ -112,6 +266,32 @@ struct GNUNET_ATS_Session
    */
   char *url;
 
+  /**
+   * Origin of @e url, NULL until the session connects.
+   */
+  struct HTTP_Origin *origin;
+
+  /**
+   * Hash of the address' URL, key in the plugin's failures map.
+   */
+  struct GNUNET_HashCode failure_key;
+
+  /**
+   * next pointer in the origin's active or waiting list
+   */
+  struct GNUNET_ATS_Session *origin_next;
+
+  /**
+   * previous pointer in the origin's active or waiting list
+   */
+  struct GNUNET_ATS_Session *origin_prev;
+
+  /**
+   * #GNUNET_YES once the transport service uses the session for the peer,
+   * that is ATS selected its address.
+   */
+  int selected;
+
   /**
    * Address
    */
@@ -127,6 +307,26 @@ struct GNUNET_ATS_Session
    */
   int get;
 
+  /**
+   * head of queue of messages waiting for a PUT
+   */
+  struct HTTP_Message *msg_head;
+
+  /**
+   * tail of queue of messages waiting for a PUT
+   */
+  struct HTTP_Message *msg_tail;
+
+  /**
+   * PUT currently in flight, NULL if none
+   */
+  struct HTTP_Put *put;
+
+  /**
+   * Task sending the queued messages in a PUT
+   */
+  struct GNUNET_SCHEDULER_Task *put_task;
+
   /**
    * Message stream tokenizer for incoming data
    */
@@ -143,6 +343,11 @@ struct GNUNET_ATS_Session
    */
   struct GNUNET_TIME_Absolute next_receive;
 
+  /**
+   * Task resuming the paused GET at @e next_receive
+   */
+  struct GNUNET_SCHEDULER_Task *recv_wakeup_task;
+
   /**
    * When does this session time out.
    */
@@ -153,6 +358,11 @@ struct GNUNET_ATS_Session
    */
   unsigned long long bytes_in_queue;
 
+  /**
+   * Number of messages waiting for transmission to this peer.
+   */
+  unsigned int msgs_in_queue;
+
   /**
    * Outbound overhead due to HTTP connection
    * Add to next message of this session when calling callback
@@ -218,6 +428,27 @@ struct HTTP_Client_Plugin
    */
   unsigned int cur_connections;
 
+  /**
+   * Maximum number of GETs open to one origin
+   */
+  unsigned int max_connections_per_origin;
+
+  /**
+   * Origins we have sessions to, by hash of their name.
+   */
+  struct GNUNET_CONTAINER_MultiHashMap *origins;
+
+  /**
+   * Negative cache of failing URLs, `struct HTTP_Failure` by hash of the
+   * URL.
+   */
+  struct GNUNET_CONTAINER_MultiHashMap *failures;
+
+  /**
+   * Task dropping expired entries from @e failures.
+   */
+  struct GNUNET_SCHEDULER_Task *failure_sweep_task;
+
   /**
    * Last used unique HTTP connection tag
    */
@@ -256,8 +487,8 @@ notify_session_monitor (struct HTTP_Client_Plugin *plugin,
   memset (&info, 0, sizeof (info));
   info.state = state;
   info.is_inbound = GNUNET_NO;
-  info.num_msg_pending = 0;
-  info.num_bytes_pending = 0;
+  info.num_msg_pending = session->msgs_in_queue;
+  info.num_bytes_pending = session->bytes_in_queue;
   info.receive_delay = session->next_receive;
   info.session_timeout = session->timeout;
   info.address = session->address;
@@ -267,6 +498,217 @@ notify_session_monitor (struct HTTP_Client_Plugin *plugin,
 }
 
 
+/**
+ * Fail all messages in a list and free them.
+ *
+ * @param target peer the messages were for
+ * @param head head of the message list
+ * @param tail tail of the message list
+ */
+static void
+client_fail_messages (const struct GNUNET_PeerIdentity *target,
+                      struct HTTP_Message **head,
+                      struct HTTP_Message **tail)
+{
+  struct HTTP_Message *msg;
+
+  while (NULL != (msg = *head))
+  {
+    GNUNET_CONTAINER_DLL_remove (*head, *tail, msg);
+    if (NULL != msg->transmit_cont)
+      msg->transmit_cont (msg->transmit_cont_cls,
+                          target,
+                          GNUNET_SYSERR,
+                          msg->size,
+                          0);
+    GNUNET_free (msg);
+  }
+}
+
+
+/**
+ * Update the statistic of the negative cache size.
+ *
+ * @param plugin the plugin
+ */
+static void
+client_failures_stat (struct HTTP_Client_Plugin *plugin)
+{
+  GNUNET_STATISTICS_set (plugin->env->stats,
+                         "# HTTP client URLs in failure cache",
+                         GNUNET_CONTAINER_multihashmap_size (plugin->failures),
+                         GNUNET_NO);
+}
+
+
+/**
+ * A request of a session failed.  Keep other sessions away from its URL
+ * for an exponentially growing, jittered time so that dead peers don't
+ * take the browser's connection slots from live ones.
+ *
+ * @param s the session
+ */
+static void
+client_record_failure (struct GNUNET_ATS_Session *s)
+{
+  struct HTTP_Client_Plugin *plugin = s->plugin;
+  struct HTTP_Failure *f;
+  struct GNUNET_TIME_Relative backoff;
+
+  f = GNUNET_CONTAINER_multihashmap_get (plugin->failures, &s->failure_key);
+  if (NULL == f)
+  {
+    f = GNUNET_new (struct HTTP_Failure);
+    f->key = s->failure_key;
+    GNUNET_assert (GNUNET_OK ==
+                   GNUNET_CONTAINER_multihashmap_put (plugin->failures,
+                                                      &f->key,
+                                                      f,
+                                                      GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+  }
+  backoff = FAILURE_BACKOFF_MIN;
+  if (f->failures < 16)
+    backoff = GNUNET_TIME_relative_multiply (backoff, 1 << f->failures);
+  else
+    backoff = FAILURE_BACKOFF_MAX;
+  backoff = GNUNET_TIME_relative_min (backoff, FAILURE_BACKOFF_MAX);
+  /* jitter: somewhere between half and all of it, so sessions that failed
+     together don't all come back together */
+  backoff.rel_value_us = backoff.rel_value_us / 2
+    + GNUNET_CRYPTO_random_u64 (GNUNET_CRYPTO_QUALITY_WEAK,
+                                backoff.rel_value_us / 2 + 1);
+  f->failures++;
+  f->retry = GNUNET_TIME_relative_to_absolute (backoff);
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Session %p: failure %u for `%s', not retrying for %s\n",
+       s, f->failures, s->url,
+       GNUNET_STRINGS_relative_time_to_string (backoff,
+                                               GNUNET_YES));
+  GNUNET_STATISTICS_update (plugin->env->stats,
+                            "# HTTP client request failures",
+                            1,
+                            GNUNET_NO);
+  client_failures_stat (plugin);
+}
+
+
+/**
+ * A request of a session succeeded, forget about earlier failures of its
+ * URL.
+ *
+ * @param s the session
+ */
+static void
+client_record_success (struct GNUNET_ATS_Session *s)
+{
+  struct HTTP_Client_Plugin *plugin = s->plugin;
+  struct HTTP_Failure *f;
+
+  f = GNUNET_CONTAINER_multihashmap_get (plugin->failures, &s->failure_key);
+  if (NULL == f)
+    return;
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap_remove (plugin->failures,
+                                                       &f->key,
+                                                       f));
+  GNUNET_free (f);
+  client_failures_stat (plugin);
+}
+
+
+/**
+ * Is a negative cache entry past #FAILURE_CACHE_TTL after its retry time?
+ *
+ * @param f the entry
+ * @return #GNUNET_YES if it should be forgotten
+ */
+static int
+client_failure_expired (const struct HTTP_Failure *f)
+{
+  if (0 != GNUNET_TIME_absolute_get_duration (
+        GNUNET_TIME_absolute_add (f->retry,
+                                  FAILURE_CACHE_TTL)).rel_value_us)
+    return GNUNET_YES;
+  return GNUNET_NO;
+}
+
+
+/**
+ * Drop an entry of the negative cache if it expired.
+ *
+ * @param cls the `struct HTTP_Client_Plugin`
+ * @param key unused
+ * @param value the `struct HTTP_Failure`
+ * @return #GNUNET_YES (continue iterating)
+ */
+static int
+client_sweep_failure_cb (void *cls,
+                         const struct GNUNET_HashCode *key,
+                         void *value)
+{
+  struct HTTP_Client_Plugin *plugin = cls;
+  struct HTTP_Failure *f = value;
+
+  if (GNUNET_YES != client_failure_expired (f))
+    return GNUNET_YES;
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap_remove (plugin->failures,
+                                                       &f->key,
+                                                       f));
+  GNUNET_free (f);
+  return GNUNET_YES;
+}
+
+
+/**
+ * Periodically drop the negative cache entries of URLs we never tried
+ * again, so the cache doesn't grow with every address we ever failed.
+ *
+ * @param cls the `struct HTTP_Client_Plugin`
+ */
+static void
+client_sweep_failures (void *cls)
+{
+  struct HTTP_Client_Plugin *plugin = cls;
+
+  plugin->failure_sweep_task = NULL;
+  GNUNET_CONTAINER_multihashmap_iterate (plugin->failures,
+                                         &client_sweep_failure_cb,
+                                         plugin);
+  client_failures_stat (plugin);
+  plugin->failure_sweep_task
+    = GNUNET_SCHEDULER_add_delayed (FAILURE_SWEEP_INTERVAL,
+                                    &client_sweep_failures,
+                                    plugin);
+}
+
+
+/**
+ * Free an entry of the negative cache.
+ *
+ * @param cls unused
+ * @param key unused
+ * @param value the `struct HTTP_Failure`
+ * @return #GNUNET_YES (continue iterating)
+ */
+static int
+client_free_failure_cb (void *cls,
+                        const struct GNUNET_HashCode *key,
+                        void *value)
+{
+  GNUNET_free (value);
+  return GNUNET_YES;
+}
+
+
+static void
+client_close_get (struct GNUNET_ATS_Session *s);
+
+
+static void
+client_start_gets (struct HTTP_Client_Plugin *plugin);
+
+
 /**
  * Delete session @a s
  *
@@ -275,7 +717,6 @@ notify_session_monitor (struct HTTP_Client_Plugin *plugin,
 static void
 client_delete_session (struct GNUNET_ATS_Session *s)
 {
-  extern void abort_xhr(double xhr);
   struct HTTP_Client_Plugin *plugin = s->plugin;
 
   if (NULL != s->timeout_task)
@@ -284,25 +725,57 @@ client_delete_session (struct GNUNET_ATS_Session *s)
     s->timeout_task = NULL;
     s->timeout = GNUNET_TIME_UNIT_ZERO_ABS;
   }
+  if (NULL != s->put_task)
+  {
+    GNUNET_SCHEDULER_cancel (s->put_task);
+    s->put_task = NULL;
+  }
+  if (NULL != s->recv_wakeup_task)
+  {
+    GNUNET_SCHEDULER_cancel (s->recv_wakeup_task);
+    s->recv_wakeup_task = NULL;
+  }
+  if (NULL != s->put)
+  {
+    /* the PUT completes without us */
+    client_fail_messages (&s->put->target,
+                          &s->put->msg_head,
+                          &s->put->msg_tail);
+    s->put->s = NULL;
+    s->put = NULL;
+  }
+  client_fail_messages (&s->address->peer, &s->msg_head, &s->msg_tail);
+  s->msgs_in_queue = 0;
+  s->bytes_in_queue = 0;
   GNUNET_assert (GNUNET_OK ==
                  GNUNET_CONTAINER_multipeermap_remove (plugin->sessions,
                                                        &s->address->peer,
                                                        s));
-  if (s->get)
+  if (NULL != s->origin)
   {
-    LOG (GNUNET_ERROR_TYPE_DEBUG,
-         "Session %p/connection %d: disconnecting GET connection to peer `%s'\n",
-         s, s->get,
-         GNUNET_i2s (&s->address->peer));
-    GNUNET_assert (plugin->cur_connections > 0);
-    plugin->cur_connections--;
-    abort_xhr(s->get);
-    s->get = 0;
+    struct HTTP_Origin *o = s->origin;
+
+    if (s->get)
+      client_close_get (s);
+    else
+      GNUNET_CONTAINER_DLL_remove2 (o->waiting_head,
+                                    o->waiting_tail,
+                                    s,
+                                    origin_next,
+                                    origin_prev);
+    s->origin = NULL;
+    if (0 == --o->sessions)
+    {
+      GNUNET_assert (GNUNET_YES ==
+                     GNUNET_CONTAINER_multihashmap_remove (plugin->origins,
+                                                           &o->key,
+                                                           o));
+      GNUNET_free (o->name);
+      GNUNET_free (o);
+    }
+    /* our GET may have been holding back another session's */
+    client_start_gets (plugin);
   }
-  GNUNET_STATISTICS_set (plugin->env->stats,
-                         HTTP_STAT_STR_CONNECTIONS,
-                         plugin->cur_connections,
-                         GNUNET_NO);
 
   notify_session_monitor (plugin,
                           s,
@@ -330,6 +803,163 @@ client_reschedule_session_timeout (struct GNUNET_ATS_Session *s)
 }
 
 
+static void
+client_schedule_put (struct GNUNET_ATS_Session *s);
+
+
+/**
+ * A PUT finished; report each message it carried to its continuation.
+ * The framing paid for the PUT is charged to the first message.
+ *
+ * @param cls the `struct HTTP_Put`
+ * @param result 1 if the PUT succeeded, -1 otherwise
+ * @param multiplexed 1 if the browser sent the PUT over HTTP/2 or later
+ */
+static void
+client_put_done (void *cls, int result, int multiplexed)
+{
+  struct HTTP_Put *put = cls;
+  struct GNUNET_ATS_Session *s = put->s;
+  struct HTTP_Message *msg;
+  size_t overhead = 0;
+
+  if (NULL != s)
+  {
+    s->put = NULL;
+    overhead = s->overhead;
+    s->overhead = 0;
+    if (1 == result)
+      client_record_success (s);
+    else
+      client_record_failure (s);
+    if ( (1 == multiplexed) &&
+         (GNUNET_NO == s->origin->multiplexed) )
+    {
+      LOG (GNUNET_ERROR_TYPE_DEBUG,
+           "Origin `%s' multiplexes requests, lifting its GET limit\n",
+           s->origin->name);
+      s->origin->multiplexed = GNUNET_YES;
+      client_start_gets (s->plugin);
+    }
+  }
+  while (NULL != (msg = put->msg_head))
+  {
+    GNUNET_CONTAINER_DLL_remove (put->msg_head, put->msg_tail, msg);
+    if (NULL != msg->transmit_cont)
+      msg->transmit_cont (msg->transmit_cont_cls,
+                          &put->target,
+                          (1 == result) ? GNUNET_OK : GNUNET_SYSERR,
+                          msg->size,
+                          msg->size + overhead);
+    overhead = 0;
+    GNUNET_free (msg);
+  }
+  GNUNET_free (put);
+  if (NULL != s)
+  {
+    notify_session_monitor (s->plugin,
+                            s,
+                            GNUNET_TRANSPORT_SS_UPDATE);
+    client_schedule_put (s);
+  }
+}
+
+
+/**
+ * Send as many queued messages as fit in one PUT body.
+ *
+ * @param s the session
+ */
+static void
+client_send_put (struct GNUNET_ATS_Session *s)
+{
+  extern void http_client_plugin_send_int(void *url, void *data,
+      double data_size, void *done, void *done_cls);
+  struct HTTP_Put *put;
+  struct HTTP_Message *msg;
+  size_t size = 0;
+  char *buf;
+
+  GNUNET_assert (NULL == s->put);
+  put = GNUNET_new (struct HTTP_Put);
+  put->s = s;
+  put->target = s->address->peer;
+  while ( (NULL != (msg = s->msg_head)) &&
+          ( (0 == size) ||
+            (size + msg->size <= PUT_MAX_SIZE) ) )
+  {
+    GNUNET_CONTAINER_DLL_remove (s->msg_head, s->msg_tail, msg);
+    GNUNET_CONTAINER_DLL_insert_tail (put->msg_head, put->msg_tail, msg);
+    s->msgs_in_queue--;
+    s->bytes_in_queue -= msg->size;
+    size += msg->size;
+  }
+  buf = GNUNET_malloc (size);
+  size = 0;
+  for (msg = put->msg_head; NULL != msg; msg = msg->next)
+  {
+    GNUNET_memcpy (&buf[size], msg->buf, msg->size);
+    size += msg->size;
+  }
+  s->overhead += strlen (s->url) + PUT_FRAMING_SIZE;
+  s->put = put;
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Session %p: Sending PUT with %llu bytes to peer `%s'\n",
+       s,
+       (unsigned long long) size, GNUNET_i2s (&s->address->peer));
+  http_client_plugin_send_int(s->url, buf, size, &client_put_done, put);
+  GNUNET_free (buf);
+}
+
+
+/**
+ * Coalescing delay is over, send what is queued.
+ *
+ * @param cls the session
+ */
+static void
+client_put_task (void *cls)
+{
+  struct GNUNET_ATS_Session *s = cls;
+
+  s->put_task = NULL;
+  if ( (NULL == s->put) &&
+       (NULL != s->msg_head) )
+    client_send_put (s);
+}
+
+
+/**
+ * Arrange for the queued messages to be sent.  Only one PUT is in flight
+ * per session, which keeps messages in order; anything queued meanwhile
+ * goes out together when it completes.  Otherwise we wait a little for
+ * more messages unless a full PUT body is already queued.
+ *
+ * @param s the session
+ */
+static void
+client_schedule_put (struct GNUNET_ATS_Session *s)
+{
+  if ( (NULL != s->put) ||
+       (NULL == s->msg_head) )
+    return;
+  if (s->bytes_in_queue >= PUT_MAX_SIZE)
+  {
+    if (NULL != s->put_task)
+    {
+      GNUNET_SCHEDULER_cancel (s->put_task);
+      s->put_task = NULL;
+    }
+    client_send_put (s);
+    return;
+  }
+  if (NULL == s->put_task)
+    s->put_task = GNUNET_SCHEDULER_add_delayed (PUT_COALESCE_DELAY,
+                                                &client_put_task,
+                                                s);
+}
+
+
 /**
  * Function that can be used by the transport service to transmit
  * a message using the plugin.   Note that in the case of a
@@ -367,15 +997,25 @@ http_client_plugin_send (void *cls,
                          GNUNET_TRANSPORT_TransmitContinuation cont,
                          void *cont_cls)
 {
-  extern void http_client_plugin_send_int(void *url, void *data,
-      double data_size, void *cont, void *cont_cls, void *target);
+  struct HTTP_Message *msg;
 
   LOG (GNUNET_ERROR_TYPE_DEBUG,
-       "Session %p: Sending message with %u to peer `%s' \n",
+       "Session %p: Queueing message with %llu to peer `%s' \n",
        s,
-       msgbuf_size, GNUNET_i2s (&s->address->peer));
-  http_client_plugin_send_int(s->url, msgbuf, msgbuf_size, cont, cont_cls,
-      &s->address->peer);
+       (unsigned long long) msgbuf_size, GNUNET_i2s (&s->address->peer));
+  msg = GNUNET_malloc (sizeof (struct HTTP_Message) + msgbuf_size);
+  msg->size = msgbuf_size;
+  msg->buf = (char *) &msg[1];
+  msg->transmit_cont = cont;
+  msg->transmit_cont_cls = cont_cls;
+  GNUNET_memcpy (msg->buf, msgbuf, msgbuf_size);
+  GNUNET_CONTAINER_DLL_insert_tail (s->msg_head, s->msg_tail, msg);
+  s->msgs_in_queue++;
+  s->bytes_in_queue += msgbuf_size;
+  notify_session_monitor (s->plugin,
+                          s,
+                          GNUNET_TRANSPORT_SS_UPDATE);
+  client_schedule_put (s);
   return msgbuf_size;
 }
 
@@ -577,14 +1217,36 @@ client_receive_mst_cb (void *cls,
 
 
 /**
- * Callback method used with libcurl when data for a GET connection are
- * received. Forward to MST
+ * Inbound bandwidth is available again, let the GET reader hand us the
+ * chunk it is holding.
  *
- * @param stream pointer where to write data
+ * @param cls the session
+ */
+static void
+client_wake_up (void *cls)
+{
+  extern void client_resume_get_int(double get);
+  struct GNUNET_ATS_Session *s = cls;
+
+  s->recv_wakeup_task = NULL;
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Session %p/connection %d: Waking up GET handle\n",
+       s, s->get);
+  if (s->get)
+    client_resume_get_int(s->get);
+}
+
+
+/**
+ * Called from the GET stream reader for every chunk received on the GET
+ * connection. Forward to MST
+ *
+ * @param stream pointer to the received chunk
  * @param size size of an individual element
- * @param nmemb count of elements that can be written to the buffer
- * @param cls destination pointer, passed to the libcurl handle
- * @return bytes read from stream
+ * @param nmemb count of elements in @a stream
+ * @param cls the session
+ * @return bytes read from stream, 0 to make the reader hold the chunk and
+ *         pause until we wake it up
  */
 static size_t
 client_receive (void *stream,
@@ -597,9 +1259,9 @@ client_receive (void *stream,
   size_t len = size * nmemb;
 
   GNUNET_log_from (GNUNET_ERROR_TYPE_DEBUG, s->plugin->name,
-                   "Session %p / connection %d: Received %u bytes from peer `%s'\n",
+                   "Session %p / connection %d: Received %llu bytes from peer `%s'\n",
                    s, s->get,
-                   len, GNUNET_i2s (&s->address->peer));
+                   (unsigned long long) len, GNUNET_i2s (&s->address->peer));
   now = GNUNET_TIME_absolute_get ();
   if (now.abs_value_us < s->next_receive.abs_value_us)
   {
@@ -613,11 +1275,19 @@ client_receive (void *stream,
          s->get,
 		     GNUNET_STRINGS_relative_time_to_string (delta,
                                                  GNUNET_YES));
+    if (NULL == s->recv_wakeup_task)
+      s->recv_wakeup_task = GNUNET_SCHEDULER_add_delayed (delta,
+                                                          &client_wake_up,
+                                                          s);
     return 0;
   }
   if (NULL == s->msg_tk)
+  {
+    /* the GET got through, the address works */
+    client_record_success (s);
     s->msg_tk = GNUNET_MST_create (&client_receive_mst_cb,
                                    s);
+  }
   GNUNET_MST_from_buffer (s->msg_tk,
                           stream,
                           len,
@@ -626,31 +1296,303 @@ client_receive (void *stream,
   return len;
 }
 
+/**
+ * The GET connection of a session failed.  Remember the failure so no
+ * new session hammers the address and end the session.
+ *
+ * @param cls the `struct HTTP_Client_Plugin *`
+ * @param s the session
+ * @return #GNUNET_OK
+ */
+static int
+client_get_failed (void *cls,
+                   struct GNUNET_ATS_Session *s)
+{
+  client_record_failure (s);
+  return http_client_plugin_session_disconnect (cls, s);
+}
+
+
 int next_xhr = 1;
 
 /**
- * Connect GET connection for a session
+ * Check if another GET may be opened to an origin.
  *
- * @param s the session to connect
- * @return #GNUNET_OK on success, #GNUNET_SYSERR otherwise
+ * @param plugin the plugin
+ * @param o the origin
+ * @return #GNUNET_YES if it may
  */
 static int
+client_can_open_get (struct HTTP_Client_Plugin *plugin,
+                     struct HTTP_Origin *o)
+{
+  if (plugin->cur_connections >= plugin->max_connections)
+    return GNUNET_NO;
+  if ( (GNUNET_YES == o->multiplexed) ||
+       (o->gets < plugin->max_connections_per_origin) )
+    return GNUNET_YES;
+  return GNUNET_NO;
+}
+
+
+/**
+ * Connect GET connection for a session waiting in its origin's queue.
+ * The GET is a single streaming fetch() which stays open and is reopened
+ * when the server ends it.
+ *
+ * @param s the session to connect
+ */
+static void
 client_connect_get (struct GNUNET_ATS_Session *s)
 {
   extern void client_connect_get_int(double get, void *s, void *url,
-      void *client_receive, void *session_disconnect, void *plugin);
-
+      void *client_receive, void *get_failed, void *plugin);
+  struct HTTP_Origin *o = s->origin;
+
+  GNUNET_CONTAINER_DLL_remove2 (o->waiting_head,
+                                o->waiting_tail,
+                                s,
+                                origin_next,
+                                origin_prev);
+  GNUNET_CONTAINER_DLL_insert_tail2 (o->active_head,
+                                     o->active_tail,
+                                     s,
+                                     origin_next,
+                                     origin_prev);
+  o->gets++;
   /* create get connection */
   s->get = next_xhr++;
   s->plugin->cur_connections++;
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Session %p: opening GET %d, %u of %u open to `%s'\n",
+       s, s->get, o->gets,
+       (GNUNET_YES == o->multiplexed)
+       ? s->plugin->max_connections
+       : s->plugin->max_connections_per_origin,
+       o->name);
   client_connect_get_int(s->get, s, s->url, &client_receive,
-      &http_client_plugin_session_disconnect, s->plugin);
+      &client_get_failed, s->plugin);
+  GNUNET_STATISTICS_set (s->plugin->env->stats,
+                         HTTP_STAT_STR_CONNECTIONS,
+                         s->plugin->cur_connections,
+                         GNUNET_NO);
+}
+
+
+/**
+ * Close the GET connection of a session.  The session stays in neither of
+ * its origin's lists.
+ *
+ * @param s the session
+ */
+static void
+client_close_get (struct GNUNET_ATS_Session *s)
+{
+  extern void abort_xhr(double xhr);
+  struct HTTP_Client_Plugin *plugin = s->plugin;
+  struct HTTP_Origin *o = s->origin;
+
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Session %p/connection %d: disconnecting GET connection to peer `%s'\n",
+       s, s->get,
+       GNUNET_i2s (&s->address->peer));
+  if (NULL != s->recv_wakeup_task)
+  {
+    GNUNET_SCHEDULER_cancel (s->recv_wakeup_task);
+    s->recv_wakeup_task = NULL;
+  }
+  GNUNET_CONTAINER_DLL_remove2 (o->active_head,
+                                o->active_tail,
+                                s,
+                                origin_next,
+                                origin_prev);
+  GNUNET_assert (o->gets > 0);
+  o->gets--;
+  GNUNET_assert (plugin->cur_connections > 0);
+  plugin->cur_connections--;
+  abort_xhr(s->get);
+  s->get = 0;
+  GNUNET_STATISTICS_set (plugin->env->stats,
+                         HTTP_STAT_STR_CONNECTIONS,
+                         plugin->cur_connections,
+                         GNUNET_NO);
+}
+
+
+/**
+ * Put a session without a GET in its origin's queue; sessions ATS
+ * selected go ahead of the others.
+ *
+ * @param s the session
+ */
+static void
+client_queue_get (struct GNUNET_ATS_Session *s)
+{
+  struct HTTP_Origin *o = s->origin;
+
+  if (GNUNET_YES == s->selected)
+    GNUNET_CONTAINER_DLL_insert2 (o->waiting_head,
+                                  o->waiting_tail,
+                                  s,
+                                  origin_next,
+                                  origin_prev);
+  else
+    GNUNET_CONTAINER_DLL_insert_tail2 (o->waiting_head,
+                                       o->waiting_tail,
+                                       s,
+                                       origin_next,
+                                       origin_prev);
+}
+
+
+/**
+ * Open the GETs of waiting sessions of an origin while the limits allow.
+ *
+ * @param cls pointer to #GNUNET_YES to only open those ATS selected
+ * @param key unused
+ * @param value the `struct HTTP_Origin`
+ * @return #GNUNET_YES (continue iterating)
+ */
+static int
+client_start_gets_cb (void *cls,
+                      const struct GNUNET_HashCode *key,
+                      void *value)
+{
+  const int *selected_only = cls;
+  struct HTTP_Origin *o = value;
+  struct GNUNET_ATS_Session *s;
+
+  while ( (NULL != (s = o->waiting_head)) &&
+          (GNUNET_YES == client_can_open_get (o->plugin, o)) )
+  {
+    /* selected sessions are at the head of the queue */
+    if ( (GNUNET_YES == *selected_only) &&
+         (GNUNET_YES != s->selected) )
+      break;
+    client_connect_get (s);
+  }
+  return GNUNET_YES;
+}
+
+
+/**
+ * Open the GETs of waiting sessions while the limits allow, those of
+ * sessions ATS selected first.
+ *
+ * @param plugin the plugin
+ */
+static void
+client_start_gets (struct HTTP_Client_Plugin *plugin)
+{
+  int selected_only;
+
+  selected_only = GNUNET_YES;
+  GNUNET_CONTAINER_multihashmap_iterate (plugin->origins,
+                                         &client_start_gets_cb,
+                                         &selected_only);
+  selected_only = GNUNET_NO;
+  GNUNET_CONTAINER_multihashmap_iterate (plugin->origins,
+                                         &client_start_gets_cb,
+                                         &selected_only);
+}
+
+
+/**
+ * The transport service is using the session, ATS selected its address.
+ * If it is still waiting for a GET, move it ahead and, if only the limit
+ * of its origin stands in the way, take the GET of a session to the same
+ * origin that ATS did not select.
+ *
+ * @param s the session
+ */
+static void
+client_session_selected (struct GNUNET_ATS_Session *s)
+{
+  struct HTTP_Client_Plugin *plugin = s->plugin;
+  struct HTTP_Origin *o = s->origin;
+  struct GNUNET_ATS_Session *victim;
+
+  if (GNUNET_YES == s->selected)
+    return;
+  s->selected = GNUNET_YES;
+  if ( (NULL == o) ||
+       (0 != s->get) )
+    return;
+  GNUNET_CONTAINER_DLL_remove2 (o->waiting_head,
+                                o->waiting_tail,
+                                s,
+                                origin_next,
+                                origin_prev);
+  client_queue_get (s);
+  if ( (GNUNET_NO == client_can_open_get (plugin, o)) &&
+       (plugin->cur_connections < plugin->max_connections) )
+  {
+    for (victim = o->active_head; NULL != victim; victim = victim->origin_next)
+      if (GNUNET_YES != victim->selected)
+        break;
+    if (NULL != victim)
+    {
+      LOG (GNUNET_ERROR_TYPE_DEBUG,
+           "Session %p: giving up GET %d to selected session %p\n",
+           victim, victim->get, s);
+      GNUNET_STATISTICS_update (plugin->env->stats,
+                                "# HTTP client GETs given up to selected sessions",
+                                1,
+                                GNUNET_NO);
+      client_close_get (victim);
+      client_queue_get (victim);
+    }
+  }
+  client_start_gets (plugin);
+}
+
+
+/**
+ * Find or create the origin of a session's URL and queue the session's
+ * GET there.
+ *
+ * @param s the session
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR if the URL has no origin
+ */
+static int
+client_join_origin (struct GNUNET_ATS_Session *s)
+{
+  struct HTTP_Client_Plugin *plugin = s->plugin;
+  struct HTTP_Origin *o;
+  struct GNUNET_HashCode key;
+  const char *host;
+  const char *path;
+
+  host = strstr (s->url, "://");
+  if (NULL == host)
+    return GNUNET_SYSERR;
+  path = strchr (host + 3, '/');
+  if (NULL == path)
+    path = host + strlen (host);
+  GNUNET_CRYPTO_hash (s->url, path - s->url, &key);
+  o = GNUNET_CONTAINER_multihashmap_get (plugin->origins, &key);
+  if (NULL == o)
+  {
+    o = GNUNET_new (struct HTTP_Origin);
+    o->plugin = plugin;
+    o->name = GNUNET_strndup (s->url, path - s->url);
+    o->key = key;
+    GNUNET_assert (GNUNET_OK ==
+                   GNUNET_CONTAINER_multihashmap_put (plugin->origins,
+                                                      &o->key,
+                                                      o,
+                                                      GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+  }
+  o->sessions++;
+  s->origin = o;
+  client_queue_get (s);
   return GNUNET_OK;
 }
 
 
 /**
- * Connect both PUT and GET connection for a session
+ * Connect both PUT and GET connection for a session, as far as the
+ * connection limits allow
  *
  * @param s the session to connect
  * @return #GNUNET_OK on success, #GNUNET_SYSERR otherwise
@@ -681,18 +1623,16 @@ client_connect (struct GNUNET_ATS_Session *s)
        "Initiating outbound session peer `%s' using address `%s'\n",
        GNUNET_i2s (&s->address->peer), s->url);
 
-  if (GNUNET_SYSERR == client_connect_get (s))
+  if (GNUNET_SYSERR == client_join_origin (s))
     return GNUNET_SYSERR;
 
-  LOG (GNUNET_ERROR_TYPE_DEBUG,
-       "Session %p: connected with connection GET %d\n",
-       s, s->get);
-
-  /* Perform connect */
-  GNUNET_STATISTICS_set (plugin->env->stats,
-                         HTTP_STAT_STR_CONNECTIONS,
-                         plugin->cur_connections,
-                         GNUNET_NO);
+  /* the GET waits in the origin's queue while the limits are reached,
+     PUTs can be sent meanwhile */
+  client_start_gets (plugin);
+  if (0 == s->get)
+    LOG (GNUNET_ERROR_TYPE_DEBUG,
+         "Session %p: GET waits for a connection to `%s'\n",
+         s, s->origin->name);
   return res;
 }
 
@@ -774,7 +1714,7 @@ client_session_timeout (void *cls)
  *
  * @param cls the plugin
  * @param address the address
- * @return the session or NULL of max connections exceeded
+ * @return the session or NULL on error
  */
 static struct GNUNET_ATS_Session *
 http_client_plugin_get_session (void *cls,
@@ -782,8 +1722,11 @@ http_client_plugin_get_session (void *cls,
 {
   struct HTTP_Client_Plugin *plugin = cls;
   struct GNUNET_ATS_Session *s;
+  struct HTTP_Failure *f;
+  struct GNUNET_HashCode failure_key;
   struct sockaddr *sa;
   enum GNUNET_NetworkType net_type;
+  const char *url;
   size_t salen = 0;
   int res;
 
@@ -794,14 +1737,44 @@ http_client_plugin_get_session (void *cls,
   if (NULL != s)
     return s;
 
-  if (plugin->max_connections <= plugin->cur_connections)
-  {
-    LOG (GNUNET_ERROR_TYPE_WARNING,
-         "Maximum number of connections (%u) reached: "
-         "cannot connect to peer `%s'\n",
-         plugin->max_connections,
-         GNUNET_i2s (&address->peer));
+  /* stay away from addresses that failed recently */
+  url = http_common_plugin_address_to_url (NULL,
+                                           address->address,
+                                           address->address_length);
+  if (NULL == url)
     return NULL;
+  GNUNET_CRYPTO_hash (url, strlen (url), &failure_key);
+  f = GNUNET_CONTAINER_multihashmap_get (plugin->failures, &failure_key);
+  if (NULL != f)
+  {
+    struct GNUNET_TIME_Relative left
+      = GNUNET_TIME_absolute_get_remaining (f->retry);
+
+    if (0 != left.rel_value_us)
+    {
+      LOG (GNUNET_ERROR_TYPE_DEBUG,
+           "Not connecting to `%s' for another %s after %u failures\n",
+           url,
+           GNUNET_STRINGS_relative_time_to_string (left,
+                                                   GNUNET_YES),
+           f->failures);
+      GNUNET_STATISTICS_update (plugin->env->stats,
+                                "# HTTP client sessions refused by failure cache",
+                                1,
+                                GNUNET_NO);
+      return NULL;
+    }
+    /* an entry that is still fresh keeps its failure count so the backoff
+       keeps growing if the retry fails too */
+    if (GNUNET_YES == client_failure_expired (f))
+    {
+      GNUNET_assert (GNUNET_YES ==
+                     GNUNET_CONTAINER_multihashmap_remove (plugin->failures,
+                                                           &f->key,
+                                                           f));
+      GNUNET_free (f);
+      client_failures_stat (plugin);
+    }
   }
 
   /* Determine network location */
@@ -837,6 +1810,7 @@ http_client_plugin_get_session (void *cls,
   s = GNUNET_new (struct GNUNET_ATS_Session);
   s->plugin = plugin;
   s->address = GNUNET_HELLO_address_copy (address);
+  s->failure_key = failure_key;
   s->scope = net_type;
   s->timeout = GNUNET_TIME_relative_to_absolute (HTTP_CLIENT_SESSION_TIMEOUT);
   s->timeout_task =  GNUNET_SCHEDULER_add_delayed (HTTP_CLIENT_SESSION_TIMEOUT,
@@ -921,6 +1895,8 @@ LIBGNUNET_PLUGIN_TRANSPORT_DONE (void *cls)
   LOG (GNUNET_ERROR_TYPE_DEBUG,
        _("Shutting down plugin `%s'\n"),
        plugin->name);
+  /* open no more GETs while the sessions go away */
+  plugin->max_connections = 0;
   GNUNET_CONTAINER_multipeermap_iterate (plugin->sessions,
                                          &destroy_session_cb,
                                          plugin);
@@ -928,6 +1904,20 @@ LIBGNUNET_PLUGIN_TRANSPORT_DONE (void *cls)
        _("Shutdown for plugin `%s' complete\n"),
        plugin->name);
   GNUNET_CONTAINER_multipeermap_destroy (plugin->sessions);
+  if (NULL != plugin->origins)
+    GNUNET_CONTAINER_multihashmap_destroy (plugin->origins);
+  if (NULL != plugin->failure_sweep_task)
+  {
+    GNUNET_SCHEDULER_cancel (plugin->failure_sweep_task);
+    plugin->failure_sweep_task = NULL;
+  }
+  if (NULL != plugin->failures)
+  {
+    GNUNET_CONTAINER_multihashmap_iterate (plugin->failures,
+                                           &client_free_failure_cb,
+                                           NULL);
+    GNUNET_CONTAINER_multihashmap_destroy (plugin->failures);
+  }
   GNUNET_free (plugin);
   GNUNET_free (api);
   return NULL;
@@ -944,6 +1934,7 @@ static int
 client_configure_plugin (struct HTTP_Client_Plugin *plugin)
 {
   unsigned long long max_connections;
+  unsigned long long max_connections_per_origin;
 
   /* Optional parameters */
   if (GNUNET_OK != GNUNET_CONFIGURATION_get_value_number (plugin->env->cfg,
@@ -951,10 +1942,17 @@ client_configure_plugin (struct HTTP_Client_Plugin *plugin)
                       "MAX_CONNECTIONS", &max_connections))
     max_connections = 128;
   plugin->max_connections = max_connections;
+  if (GNUNET_OK != GNUNET_CONFIGURATION_get_value_number (plugin->env->cfg,
+                      plugin->name,
+                      "MAX_CONNECTIONS_PER_ORIGIN",
+                      &max_connections_per_origin))
+    max_connections_per_origin = DEFAULT_MAX_CONNECTIONS_PER_ORIGIN;
+  plugin->max_connections_per_origin = max_connections_per_origin;
 
   LOG (GNUNET_ERROR_TYPE_DEBUG,
-       _("Maximum number of connections is %u\n"),
-       plugin->max_connections);
+       _("Maximum number of connections is %u, %u per origin\n"),
+       plugin->max_connections,
+       plugin->max_connections_per_origin);
   return GNUNET_OK;
 }
 
@@ -999,6 +1997,8 @@ http_client_plugin_update_session_timeout (void *cls,
                                            struct GNUNET_ATS_Session *session)
 {
   client_reschedule_session_timeout (session);
+  /* only the session of the address ATS selected is kept alive */
+  client_session_selected (session);
 }
 
 
@@ -1018,11 +2018,21 @@ http_client_plugin_update_inbound_delay (void *cls,
                                          struct GNUNET_ATS_Session *s,
                                          struct GNUNET_TIME_Relative delay)
 {
+  /* quotas are only applied to the session of the address ATS selected */
+  client_session_selected (s);
   s->next_receive = GNUNET_TIME_relative_to_absolute (delay);
   LOG (GNUNET_ERROR_TYPE_DEBUG,
        "New inbound delay %s\n",
        GNUNET_STRINGS_relative_time_to_string (delay,
                                                GNUNET_NO));
+  if (NULL != s->recv_wakeup_task)
+  {
+    /* the reader is paused, resume it at the new time */
+    GNUNET_SCHEDULER_cancel (s->recv_wakeup_task);
+    s->recv_wakeup_task = GNUNET_SCHEDULER_add_delayed (delay,
+                                                        &client_wake_up,
+                                                        s);
+  }
 }
 
 
@@ -1111,6 +2121,14 @@ LIBGNUNET_PLUGIN_TRANSPORT_INIT (void *cls)
   plugin->env = env;
   plugin->sessions = GNUNET_CONTAINER_multipeermap_create (128,
                                                            GNUNET_YES);
+  plugin->origins = GNUNET_CONTAINER_multihashmap_create (16,
+                                                          GNUNET_NO);
+  plugin->failures = GNUNET_CONTAINER_multihashmap_create (16,
+                                                           GNUNET_NO);
+  plugin->failure_sweep_task
+    = GNUNET_SCHEDULER_add_delayed (FAILURE_SWEEP_INTERVAL,
+                                    &client_sweep_failures,
+                                    plugin);
   api = GNUNET_new (struct GNUNET_TRANSPORT_PluginFunctions);
   api->cls = plugin;
   api->send = &http_client_plugin_send;
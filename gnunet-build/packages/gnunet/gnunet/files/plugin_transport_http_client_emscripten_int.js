@@ -17,68 +17,144 @@
 mergeInto(LibraryManager.library, {
   abort_xhr: function(xhr) {
     //console.debug('Aborting xhr: ' + xhr);
+    clearTimeout(xhrs[xhr].timer);
     xhrs[xhr].abort();
+    delete xhrs[xhr];
   },
+  // Whether the browser multiplexes the requests to an origin, by origin,
+  // read from the resource timing of the first PUT to it
+  $HTTP_CLIENT_TIMING: {multiplexed: {}, listening: false},
+  // Over HTTP/2 and later all requests to the origin share one connection.
+  // nextHopProtocol is empty for a cross-origin response without a
+  // Timing-Allow-Origin header, so such an origin counts as not
+  // multiplexed.  Timing entries are dropped when the buffer fills up
+  // rather than after every PUT, which would also drop those of other
+  // origins before they were read.
+  $http_client_multiplexed__deps: ['$HTTP_CLIENT_TIMING'],
+  $http_client_multiplexed: function(url) {
+    var origin = new URL(url, location.href).origin;
+    if (origin in HTTP_CLIENT_TIMING.multiplexed) {
+      return HTTP_CLIENT_TIMING.multiplexed[origin];
+    }
+    if (!self.performance || !performance.getEntriesByName) {
+      return 0;
+    }
+    if (!HTTP_CLIENT_TIMING.listening && performance.addEventListener) {
+      HTTP_CLIENT_TIMING.listening = true;
+      performance.addEventListener('resourcetimingbufferfull', function() {
+        performance.clearResourceTimings();
+      });
+    }
+    var entries = performance.getEntriesByName(url);
+    if (0 == entries.length) {
+      return 0;
+    }
+    var multiplexed = 0;
+    entries.forEach(function(entry) {
+      if (/^h[23]/.test(entry.nextHopProtocol || '')) {
+        multiplexed = 1;
+      }
+    });
+    HTTP_CLIENT_TIMING.multiplexed[origin] = multiplexed;
+    return multiplexed;
+  },
+  http_client_plugin_send_int__deps: ['$http_client_multiplexed'],
   http_client_plugin_send_int: function(url_pointer, data_pointer, data_size,
-                                   cont, cont_cls, target) {
+                                   done, done_cls) {
     var url = UTF8ToString(url_pointer);
+    // send() copies the body, so the caller may free it once we return
     var data = HEAP8.subarray(data_pointer, data_pointer + data_size);
     var xhr = new XMLHttpRequest();
     xhr.open('PUT', url);
     xhr.send(data);
     xhr.onload = function(e) {
       //console.debug('put onload readyState ' + xhr.readyState + ' status ' + xhr.status);
-      if (cont) {
-        dynCall('viiiii', cont, [cont_cls, target, 1, data_size, data_size]);
-      }
+      var ok = xhr.status >= 200 && xhr.status < 300;
+      dynCall('viii', done, [done_cls, ok ? 1 : -1,
+                             http_client_multiplexed(url)]);
     };
     xhr.onerror = function(e) {
       //console.debug('put onerror readyState ' + xhr.readyState + ' status ' + xhr.status);
-      if (cont) {
-        dynCall('viiiii', cont, [cont_cls, target, -1, data_size, data_size]);
-      }
+      dynCall('viii', done, [done_cls, -1, 0]);
     };
   },
+  client_resume_get_int: function(get) {
+    var controller = xhrs[get];
+    if (controller && controller.resume) {
+      controller.resume();
+    }
+  },
   client_connect_get_int: function(get, s, url_pointer, client_receive,
-                              session_disconnect, plugin) {
+                              get_failed, plugin) {
     var url = UTF8ToString(url_pointer);
-    //console.debug('Creating new get xhr: ' + get);
-    var xhr = new XMLHttpRequest();
-    xhrs[get] = xhr;
-    xhr.responseType = 'arraybuffer';
-    xhr.resend = function() {
-      xhr.open('GET', url + ',1');
-      xhr.send();
-    };
-    xhr.onreadystatechange = function() {
-      //console.debug('xhr' + get + ' readyState ' + xhr.readyState +
-      //    ' status ' +  xhr.status + ':' + xhr.statusText);
-    };
-    xhr.onload = function(e) {
-      var response = new Uint8Array(e.target.response);
-      //console.debug('xhr' + get + ' got ' + response.length + ' bytes');
-      ccallFunc(getFuncWrapper(client_receive, 'iiiii'), 'number',
-        ['array', 'number', 'number', 'number'],
-        [response, response.length, 1, s]);
-      xhr.resend();
-    };
-    xhr.onerror = function(e) {
-      //console.debug('xhr' + get + ' status:'
-      //  + xhr.status + ':' + xhr.statusText);
+    // One streaming GET per session; the server only ends it on its own
+    // timeout, after which we open a fresh one.  A server that keeps ending
+    // it without sending anything is reopened with exponential backoff.
+    var controller = new AbortController();
+    xhrs[get] = controller;
+    var receive = getFuncWrapper(client_receive, 'iiiii');
+    var empty = 0;
+    var disconnect = function() {
       ccallFunc(
-        getFuncWrapper(session_disconnect, 'iii'),
+        getFuncWrapper(get_failed, 'iii'),
         'number',
         ['number', 'number'],
         [plugin, s]);
     };
-    xhr.onabort = function() {
-      //console.debug('xhr' + get + ' aborted');
+    // Hand a chunk to the plugin; if it is out of inbound bandwidth it
+    // takes nothing, so hold the chunk and stop reading until
+    // client_resume_get_int is called
+    var deliver = function(chunk) {
+      var taken = ccallFunc(receive, 'number',
+        ['array', 'number', 'number', 'number'],
+        [chunk, chunk.length, 1, s]);
+      if (0 === taken) {
+        return new Promise(function(resolve) {
+          controller.resume = function() {
+            controller.resume = null;
+            resolve(deliver(chunk));
+          };
+        });
+      }
     };
-    xhr.ontimeout = function() {
-      //console.debug('xhr' + get + ' timedout');
-      xhr.resend();
+    var open = function() {
+      fetch(url, {cache: 'no-store', signal: controller.signal})
+        .then(function(response) {
+          if (!response.ok) {
+            throw new Error('GET ' + url + ' status ' + response.status);
+          }
+          var reader = response.body.getReader();
+          var received = false;
+          var pump = function() {
+            return reader.read().then(function(result) {
+              if (result.done) {
+                if (received) {
+                  empty = 0;
+                  open();
+                  return;
+                }
+                // between 1/2 and 1 of 1s, 2s, 4s, ... up to a minute
+                var delay = Math.min(1000 * Math.pow(2, empty), 60000);
+                empty++;
+                delay = delay / 2 + Math.random() * delay / 2;
+                controller.timer = setTimeout(open, delay);
+                return;
+              }
+              received = true;
+              // feed each chunk to the tokenizer as soon as it arrives
+              return Promise.resolve(deliver(result.value)).then(pump);
+            });
+          };
+          return pump();
+        })
+        .catch(function(e) {
+          if (!controller.signal.aborted) {
+            //console.debug('get' + get + ' failed: ' + e);
+            disconnect();
+          }
+        });
     };
-    xhr.resend();
+    open();
   }
 });
 
@@ -37,12 +37,273 @@
 #define MESSAGE_TYPE_WEBRTC_OFFER 1
 #define MESSAGE_TYPE_WEBRTC_ANSWER 2
 
+/**
+ * Stop handing messages to the data channel while this many bytes are
+ * buffered in it or on their way to it.
+ */
+#define WEBRTC_HIGH_WATER (256 * 1024)
+
+/**
+ * Per-message overhead on the wire: DTLS record header, SCTP common
+ * header and DATA chunk header.
+ */
+#define WEBRTC_OVERHEAD (13 + 16 + 12 + 16)
+
+/**
+ * Events reported by the page through event_cb().
+ */
+#define WEBRTC_EVENT_OPEN 1
+#define WEBRTC_EVENT_SENT 2
+#define WEBRTC_EVENT_BUFFERED 3
+#define WEBRTC_EVENT_CLOSE 4
+
+/**
+ * Data channels, by their index in data-channel-configs in webrtc.cljs.
+ * The bulk channel is unordered and never retransmits; the control channel
+ * is reliable and ordered.
+ */
+#define WEBRTC_CHANNEL_BULK 0
+#define WEBRTC_CHANNEL_CONTROL 1
+#define WEBRTC_CHANNELS 2
+
+/**
+ * Largest data channel message we send, frame header included.  Browsers
+ * do not agree on anything larger.  With this size a GNUnet message never
+ * has more than 5 fragments, so a fragment bitmap fits in a byte.
+ */
+#define WEBRTC_FRAGMENT_MAX (16 * 1024)
+
+/**
+ * Payload bytes per fragment.
+ */
+#define WEBRTC_FRAGMENT_PAYLOAD \
+  (WEBRTC_FRAGMENT_MAX - sizeof (struct WebRTCFrameHeader))
+
+/**
+ * Frame types.
+ */
+#define WEBRTC_FRAME_DATA 0
+#define WEBRTC_FRAME_NACK 1
+
+/**
+ * Partially received messages kept per channel; the oldest is dropped to
+ * make room.  Also the number of completed message ids remembered to
+ * recognize late retransmissions.
+ */
+#define WEBRTC_REASSEMBLY_MAX 16
+
+/**
+ * How often to ask for the missing fragments of a message.
+ */
+#define WEBRTC_NACK_DELAY \
+  GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS, 50)
+
+/**
+ * How many times to ask for the missing fragments of a message.
+ */
+#define WEBRTC_NACK_MAX 3
+
+/**
+ * Drop a partially received message after this long.
+ */
+#define WEBRTC_REASSEMBLY_TIMEOUT \
+  GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS, 500)
+
+/**
+ * Bytes of sent bulk messages kept to answer NACKs.
+ */
+#define WEBRTC_RETRANSMIT_BUFFER (256 * 1024)
+
+/**
+ * Offers sent over CADET and not yet answered, across all sessions.
+ * Further offers wait in the plugin's SDP queue.
+ */
+#define WEBRTC_OFFERS_MAX 16
+
+/**
+ * Drop an SDP that could not be sent over CADET for this long, its ICE
+ * candidates are likely no longer any good.
+ */
+#define WEBRTC_SDP_STALE \
+  GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 30)
+
+/**
+ * Give up on a session whose offer was not answered for this long, so a
+ * silent peer does not hold one of the #WEBRTC_OFFERS_MAX slots.
+ */
+#define WEBRTC_ANSWER_TIMEOUT \
+  GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 30)
+
+/**
+ * Disconnect a session after it was idle for this long.
+ */
+#define WEBRTC_SESSION_TIMEOUT GNUNET_CONSTANTS_IDLE_CONNECTION_TIMEOUT
+
 /**
  * Encapsulation of all of the state of the plugin.
  */
 struct Plugin;
 
 
+GNUNET_NETWORK_STRUCT_BEGIN
+
+/**
+ * Header in front of every data channel message.
+ */
+struct WebRTCFrameHeader
+{
+  /**
+   * One of the WEBRTC_FRAME_* values.
+   */
+  uint8_t type;
+
+  /**
+   * #WEBRTC_FRAME_DATA: index of the fragment.
+   * #WEBRTC_FRAME_NACK: bitmap of the fragments that are missing.
+   */
+  uint8_t fragment;
+
+  /**
+   * #WEBRTC_FRAME_DATA: size of the whole message, in NBO.
+   */
+  uint16_t size GNUNET_PACKED;
+
+  /**
+   * Id of the message, in NBO.
+   */
+  uint32_t id GNUNET_PACKED;
+};
+
+GNUNET_NETWORK_STRUCT_END
+
+
+/**
+ * Message waiting for, or on its way to, the data channel.
+ */
+struct WebRTCMessage
+{
+  /**
+   * next pointer for double linked list
+   */
+  struct WebRTCMessage *next;
+
+  /**
+   * previous pointer for double linked list
+   */
+  struct WebRTCMessage *prev;
+
+  /**
+   * Continuation function to call once the message is sent, NULL if
+   * there is no continuation to call.
+   */
+  GNUNET_TRANSPORT_TransmitContinuation transmit_cont;
+
+  /**
+   * Closure for @e transmit_cont.
+   */
+  void *transmit_cont_cls;
+
+  /**
+   * Id of the message in its frames.
+   */
+  uint32_t id;
+
+  /**
+   * Data channel the message goes on, one of the WEBRTC_CHANNEL_* values.
+   */
+  unsigned int channel;
+
+  /**
+   * One of the WEBRTC_FRAME_* values.
+   */
+  uint8_t type;
+
+  /**
+   * Bitmap of the fragments to send; for a NACK, of the fragments that
+   * are missing.
+   */
+  uint8_t fragments;
+
+  /**
+   * Fragments handed to the page but not yet to the data channel.
+   */
+  unsigned int fragments_pending;
+
+  /**
+   * message length
+   */
+  size_t size;
+
+  /* followed by the message */
+};
+
+
+/**
+ * Message we have received some of the fragments of.
+ */
+struct WebRTCReassembly
+{
+  /**
+   * next pointer for double linked list
+   */
+  struct WebRTCReassembly *next;
+
+  /**
+   * previous pointer for double linked list
+   */
+  struct WebRTCReassembly *prev;
+
+  /**
+   * When the first fragment arrived.
+   */
+  struct GNUNET_TIME_Absolute start;
+
+  /**
+   * Id of the message.
+   */
+  uint32_t id;
+
+  /**
+   * Size of the whole message.
+   */
+  uint16_t size;
+
+  /**
+   * Bitmap of the fragments still missing.
+   */
+  uint8_t missing;
+
+  /**
+   * Number of NACKs sent for the message.
+   */
+  unsigned int nacks;
+
+  /* followed by @e size bytes of message */
+};
+
+
+/**
+ * Session state.
+ */
+enum WebRTCSessionState
+{
+  /**
+   * Waiting for the page to produce our offer or answer.
+   */
+  WEBRTC_SESSION_INIT,
+
+  /**
+   * Offer and answer exchanged, waiting for the data channel to open.
+   */
+  WEBRTC_SESSION_HANDSHAKE,
+
+  /**
+   * Data channel is open.
+   */
+  WEBRTC_SESSION_UP
+};
+
+
 /**
  * Session handle for connections.
  */
@@ -53,54 +314,192 @@ struct GNUNET_ATS_Session
    */
   struct GNUNET_PeerIdentity peer;
 
+  /**
+   * Address of the peer.
+   */
+  struct GNUNET_HELLO_Address *address;
+
   /**
    * Pointer to the global plugin struct.
    */
   struct Plugin *plugin;
 
   /**
-   * Cadet channel for SDP exchange.
+   * Cadet channel for SDP exchange, NULL once it is gone.
    */
   struct GNUNET_CADET_Channel *channel;
 
+  /**
+   * next pointer for the plugin's SDP queue
+   */
+  struct GNUNET_ATS_Session *sdp_next;
+
+  /**
+   * previous pointer for the plugin's SDP queue
+   */
+  struct GNUNET_ATS_Session *sdp_prev;
+
+  /**
+   * Our offer or answer waiting for room on @e channel, NULL if none.
+   */
+  struct GNUNET_MQ_Envelope *sdp_env;
+
+  /**
+   * When @e sdp_env was queued.
+   */
+  struct GNUNET_TIME_Absolute sdp_queued;
+
+  /**
+   * When the session was created, to report how long signalling took.
+   */
+  struct GNUNET_TIME_Absolute setup_start;
+
+  /**
+   * Messages CADET lets us put on @e channel.
+   */
+  int window;
+
+  /**
+   * #GNUNET_YES if @e sdp_env is an offer.
+   */
+  int sdp_is_offer;
+
+  /**
+   * #GNUNET_YES if our offer was sent and is not answered yet.
+   */
+  int offer_outstanding;
+
+  /**
+   * Task giving up on the session if its offer is not answered in time,
+   * NULL unless @e offer_outstanding.
+   */
+  struct GNUNET_SCHEDULER_Task *answer_task;
+
   /**
    * Handle to RTCPeerConnection
    */
   int rtc_peer_connection;
 
   /**
-   * The client (used to identify this connection)
+   * Where the session is in connection setup.
    */
-  /* void *client; */
+  enum WebRTCSessionState state;
 
   /**
-   * Continuation function to call once the transmission buffer
-   * has again space available.  NULL if there is no
-   * continuation to call.
+   * #GNUNET_YES if the other peer opened the session.
    */
-  GNUNET_TRANSPORT_TransmitContinuation transmit_cont;
+  int is_inbound;
 
   /**
-   * Closure for @e transmit_cont.
+   * heads of queues of messages waiting for each data channel
    */
-  void *transmit_cont_cls;
+  struct WebRTCMessage *msg_head[WEBRTC_CHANNELS];
+
+  /**
+   * tails of queues of messages waiting for each data channel
+   */
+  struct WebRTCMessage *msg_tail[WEBRTC_CHANNELS];
+
+  /**
+   * head of messages handed to the page but not yet to the data channel
+   */
+  struct WebRTCMessage *sent_head;
+
+  /**
+   * tail of messages handed to the page but not yet to the data channel
+   */
+  struct WebRTCMessage *sent_tail;
+
+  /**
+   * head of sent bulk messages kept to answer NACKs
+   */
+  struct WebRTCMessage *retx_head;
+
+  /**
+   * tail of sent bulk messages kept to answer NACKs
+   */
+  struct WebRTCMessage *retx_tail;
+
+  /**
+   * heads of partially received messages on each data channel
+   */
+  struct WebRTCReassembly *reasm_head[WEBRTC_CHANNELS];
+
+  /**
+   * tails of partially received messages on each data channel
+   */
+  struct WebRTCReassembly *reasm_tail[WEBRTC_CHANNELS];
+
+  /**
+   * Ids of the messages last reassembled on each data channel.
+   */
+  uint32_t reasm_done[WEBRTC_CHANNELS][WEBRTC_REASSEMBLY_MAX];
 
   /**
-   * At what time did we reset @e last_received last?
+   * Number of entries in the @e reasm_head lists.
    */
-  struct GNUNET_TIME_Absolute last_quota_update;
+  unsigned int reasm_count[WEBRTC_CHANNELS];
 
   /**
-   * How many bytes have we received since the @e last_quota_update
-   * timestamp?
+   * Next slot to use in @e reasm_done.
    */
-  uint64_t last_received;
+  unsigned int reasm_done_next[WEBRTC_CHANNELS];
 
   /**
-   * Number of bytes per ms that this peer is allowed
-   * to send to us.
+   * Task to time out partially received messages and to ask for their
+   * missing fragments.
    */
-  uint32_t quota;
+  struct GNUNET_SCHEDULER_Task *reassembly_task;
+
+  /**
+   * Message stream tokenizer for incoming data
+   */
+  struct GNUNET_MessageStreamTokenizer *msg_tk;
+
+  /**
+   * Number of bytes waiting for transmission to this peer.
+   */
+  unsigned long long bytes_in_queue;
+
+  /**
+   * Number of messages waiting for transmission to this peer.
+   */
+  unsigned int msgs_in_queue;
+
+  /**
+   * Bytes of frames handed to the page but not yet to the data channel.
+   */
+  size_t bytes_in_flight;
+
+  /**
+   * Bytes of messages in the @e retx_head list.
+   */
+  size_t retx_bytes;
+
+  /**
+   * Id of the last message we sent.
+   */
+  uint32_t last_id;
+
+  /**
+   * bufferedAmount of the data channel as last reported by the page.
+   */
+  size_t buffered;
+
+  /**
+   * Absolute time when to receive data again
+   */
+  struct GNUNET_TIME_Absolute next_receive;
+
+  /**
+   * When the session times out if nothing happens on it.
+   */
+  struct GNUNET_TIME_Absolute timeout;
+
+  /**
+   * Task disconnecting the session when it was idle for too long.
+   */
+  struct GNUNET_SCHEDULER_Task *timeout_task;
 
 };
 
@@ -143,6 +542,31 @@ struct Plugin
    * Pre-computed port "number".
    */
   struct GNUNET_HashCode port;
+
+  /**
+   * Head of sessions with an SDP waiting for room on their CADET channel.
+   */
+  struct GNUNET_ATS_Session *sdp_head;
+
+  /**
+   * Tail of sessions with an SDP waiting for room on their CADET channel.
+   */
+  struct GNUNET_ATS_Session *sdp_tail;
+
+  /**
+   * Task to drop stale SDPs from the queue.
+   */
+  struct GNUNET_SCHEDULER_Task *sdp_task;
+
+  /**
+   * Number of sessions with #GNUNET_YES in @e offer_outstanding.
+   */
+  unsigned int offers_outstanding;
+
+  /**
+   * #GNUNET_YES to ask for and to resend lost fragments of bulk messages.
+   */
+  int retransmit;
 };
 
 
@@ -161,19 +585,366 @@ notify_session_monitor (struct Plugin *plugin,
 {
   struct GNUNET_TRANSPORT_SessionInfo info;
 
-  if (NULL == plugin->sic)
-    return;
-  memset (&info, 0, sizeof (info));
-  info.state = state;
-  info.is_inbound = GNUNET_SYSERR; /* FIXME */
-  // info.num_msg_pending =
-  // info.num_bytes_pending =
-  // info.receive_delay =
-  // info.session_timeout = session->timeout;
-  // info.address = session->address;
-  plugin->sic (plugin->sic_cls,
-               session,
-               &info);
+  if (NULL == plugin->sic)
+    return;
+  memset (&info, 0, sizeof (info));
+  info.state = state;
+  info.is_inbound = session->is_inbound;
+  info.num_msg_pending = session->msgs_in_queue;
+  info.num_bytes_pending = session->bytes_in_queue;
+  info.receive_delay = session->next_receive;
+  info.session_timeout = session->timeout;
+  info.address = session->address;
+  plugin->sic (plugin->sic_cls,
+               session,
+               &info);
+}
+
+
+extern int peer_connect(void *, void *, void *, void *, void *, int, void *);
+extern void peer_send(int, int, void *, int);
+extern void peer_disconnect(int);
+extern void set_remote_answer(int, void *, int);
+extern void webrtc_count_copy(int);
+
+
+/**
+ * Fail all messages in a list and free them.
+ *
+ * @param s the session
+ * @param head head of the message list
+ * @param tail tail of the message list
+ */
+static void
+fail_messages (struct GNUNET_ATS_Session *s,
+               struct WebRTCMessage **head,
+               struct WebRTCMessage **tail)
+{
+  struct WebRTCMessage *msg;
+
+  while (NULL != (msg = *head))
+  {
+    GNUNET_CONTAINER_DLL_remove (*head, *tail, msg);
+    if (NULL != msg->transmit_cont)
+      msg->transmit_cont (msg->transmit_cont_cls,
+                          &s->peer,
+                          GNUNET_SYSERR,
+                          msg->size,
+                          0);
+    GNUNET_free (msg);
+  }
+}
+
+
+/**
+ * Number of fragments a message of @a size bytes is sent in.
+ *
+ * @param size size of the message
+ * @return number of fragments
+ */
+static unsigned int
+fragment_count (size_t size)
+{
+  if (0 == size)
+    return 1;
+  return (size + WEBRTC_FRAGMENT_PAYLOAD - 1) / WEBRTC_FRAGMENT_PAYLOAD;
+}
+
+
+/**
+ * Add a message to the queue of its data channel.
+ *
+ * @param s the session
+ * @param msg the message
+ */
+static void
+enqueue_message (struct GNUNET_ATS_Session *s,
+                 struct WebRTCMessage *msg)
+{
+  GNUNET_CONTAINER_DLL_insert_tail (s->msg_head[msg->channel],
+                                    s->msg_tail[msg->channel],
+                                    msg);
+  s->msgs_in_queue++;
+  s->bytes_in_queue += msg->size;
+}
+
+
+/**
+ * Take a message off the head of its queue and hand its fragments to the
+ * page.
+ *
+ * @param s the session
+ * @param msg the message
+ */
+static void
+send_message (struct GNUNET_ATS_Session *s,
+              struct WebRTCMessage *msg)
+{
+  char buf[WEBRTC_FRAGMENT_MAX];
+  struct WebRTCFrameHeader *hdr = (struct WebRTCFrameHeader *) buf;
+  const char *payload = (const char *) &msg[1];
+  unsigned int i;
+  size_t len;
+
+  GNUNET_CONTAINER_DLL_remove (s->msg_head[msg->channel],
+                               s->msg_tail[msg->channel],
+                               msg);
+  s->msgs_in_queue--;
+  s->bytes_in_queue -= msg->size;
+  hdr->type = msg->type;
+  hdr->size = htons ((uint16_t) msg->size);
+  hdr->id = htonl (msg->id);
+  msg->fragments_pending = 0;
+  if (WEBRTC_FRAME_NACK == msg->type)
+  {
+    hdr->fragment = msg->fragments;
+    peer_send (s->rtc_peer_connection, msg->channel, buf, sizeof (*hdr));
+    s->bytes_in_flight += sizeof (*hdr);
+    msg->fragments_pending++;
+  }
+  else
+  {
+    for (i = 0; i < fragment_count (msg->size); i++)
+    {
+      if (0 == (msg->fragments & (1 << i)))
+        continue;
+      len = GNUNET_MIN (WEBRTC_FRAGMENT_PAYLOAD,
+                        msg->size - i * WEBRTC_FRAGMENT_PAYLOAD);
+      hdr->fragment = i;
+      GNUNET_memcpy (&hdr[1], &payload[i * WEBRTC_FRAGMENT_PAYLOAD], len);
+      webrtc_count_copy (GNUNET_YES);
+      peer_send (s->rtc_peer_connection, msg->channel, buf,
+                 sizeof (*hdr) + len);
+      s->bytes_in_flight += sizeof (*hdr) + len;
+      msg->fragments_pending++;
+    }
+  }
+  GNUNET_break (0 < msg->fragments_pending);
+  GNUNET_CONTAINER_DLL_insert_tail (s->sent_head, s->sent_tail, msg);
+}
+
+
+/**
+ * Hand queued messages to the page.  Control messages go right away, bulk
+ * messages while the data channels have room.
+ *
+ * @param s the session
+ */
+static void
+flush_queue (struct GNUNET_ATS_Session *s)
+{
+  struct WebRTCMessage *msg;
+
+  if (WEBRTC_SESSION_UP != s->state)
+    return;
+  while (NULL != (msg = s->msg_head[WEBRTC_CHANNEL_CONTROL]))
+    send_message (s, msg);
+  while ( (NULL != (msg = s->msg_head[WEBRTC_CHANNEL_BULK])) &&
+          (s->bytes_in_flight + s->buffered < WEBRTC_HIGH_WATER) )
+    send_message (s, msg);
+}
+
+
+/**
+ * All fragments of a message reached the data channel.  Bulk messages are
+ * kept a while to answer NACKs when retransmission is on.
+ *
+ * @param s the session
+ * @param msg the message, at the head of the sent list
+ */
+static void
+message_sent (struct GNUNET_ATS_Session *s,
+              struct WebRTCMessage *msg)
+{
+  struct Plugin *plugin = s->plugin;
+
+  GNUNET_CONTAINER_DLL_remove (s->sent_head, s->sent_tail, msg);
+  if (NULL != msg->transmit_cont)
+  {
+    msg->transmit_cont (msg->transmit_cont_cls,
+                        &s->peer,
+                        GNUNET_OK,
+                        msg->size,
+                        msg->size + fragment_count (msg->size)
+                        * (sizeof (struct WebRTCFrameHeader)
+                           + WEBRTC_OVERHEAD));
+    msg->transmit_cont = NULL;
+  }
+  if ( (GNUNET_YES != plugin->retransmit) ||
+       (WEBRTC_FRAME_DATA != msg->type) ||
+       (WEBRTC_CHANNEL_BULK != msg->channel) ||
+       (1 == fragment_count (msg->size)) )
+  {
+    /* nothing to resend: a lost single fragment message is never missed
+       by the other peer */
+    GNUNET_free (msg);
+    return;
+  }
+  GNUNET_CONTAINER_DLL_insert_tail (s->retx_head, s->retx_tail, msg);
+  s->retx_bytes += msg->size;
+  while (s->retx_bytes > WEBRTC_RETRANSMIT_BUFFER)
+  {
+    msg = s->retx_head;
+    GNUNET_CONTAINER_DLL_remove (s->retx_head, s->retx_tail, msg);
+    s->retx_bytes -= msg->size;
+    GNUNET_free (msg);
+  }
+}
+
+
+/**
+ * The other peer is missing fragments of a bulk message, resend them if we
+ * still have it.
+ *
+ * @param s the session
+ * @param id id of the message
+ * @param missing bitmap of the missing fragments
+ */
+static void
+handle_nack (struct GNUNET_ATS_Session *s,
+             uint32_t id,
+             uint8_t missing)
+{
+  struct Plugin *plugin = s->plugin;
+  struct WebRTCMessage *msg;
+  unsigned int i;
+  unsigned int count;
+
+  for (msg = s->retx_head; NULL != msg; msg = msg->next)
+    if (msg->id == id)
+      break;
+  if (NULL == msg)
+  {
+    /* not buffered, or still on its way to the data channel */
+    GNUNET_STATISTICS_update (plugin->env->stats,
+                              "# webrtc NACKs for messages not buffered",
+                              1,
+                              GNUNET_NO);
+    return;
+  }
+  missing &= (1 << fragment_count (msg->size)) - 1;
+  if (0 == missing)
+  {
+    GNUNET_break_op (0);
+    return;
+  }
+  count = 0;
+  for (i = 0; i < fragment_count (msg->size); i++)
+    if (0 != (missing & (1 << i)))
+      count++;
+  GNUNET_STATISTICS_update (plugin->env->stats,
+                            "# webrtc fragments retransmitted",
+                            count,
+                            GNUNET_NO);
+  GNUNET_CONTAINER_DLL_remove (s->retx_head, s->retx_tail, msg);
+  s->retx_bytes -= msg->size;
+  msg->fragments = missing;
+  /* resent fragments go ahead of new data */
+  GNUNET_CONTAINER_DLL_insert (s->msg_head[WEBRTC_CHANNEL_BULK],
+                               s->msg_tail[WEBRTC_CHANNEL_BULK],
+                               msg);
+  s->msgs_in_queue++;
+  s->bytes_in_queue += msg->size;
+  flush_queue (s);
+}
+
+
+/**
+ * Our offer is answered or the session is going away, free its slot.
+ *
+ * @param s the session
+ */
+static void
+release_offer (struct GNUNET_ATS_Session *s)
+{
+  if (NULL != s->answer_task)
+  {
+    GNUNET_SCHEDULER_cancel (s->answer_task);
+    s->answer_task = NULL;
+  }
+  if (GNUNET_YES != s->offer_outstanding)
+    return;
+  s->offer_outstanding = GNUNET_NO;
+  s->plugin->offers_outstanding--;
+}
+
+
+/**
+ * Release everything a session holds and free it.
+ *
+ * @param s the session
+ */
+static void
+delete_session (struct GNUNET_ATS_Session *s)
+{
+  struct Plugin *plugin = s->plugin;
+  struct WebRTCReassembly *r;
+  unsigned int channel;
+
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multipeermap_remove (plugin->sessions,
+                                                       &s->peer,
+                                                       s));
+  if (NULL != s->sdp_env)
+  {
+    GNUNET_CONTAINER_DLL_remove2 (plugin->sdp_head,
+                                  plugin->sdp_tail,
+                                  s,
+                                  sdp_next,
+                                  sdp_prev);
+    GNUNET_MQ_discard (s->sdp_env);
+    s->sdp_env = NULL;
+  }
+  release_offer (s);
+  fail_messages (s, &s->sent_head, &s->sent_tail);
+  for (channel = 0; channel < WEBRTC_CHANNELS; channel++)
+  {
+    fail_messages (s, &s->msg_head[channel], &s->msg_tail[channel]);
+    while (NULL != (r = s->reasm_head[channel]))
+    {
+      GNUNET_CONTAINER_DLL_remove (s->reasm_head[channel],
+                                   s->reasm_tail[channel],
+                                   r);
+      GNUNET_free (r);
+    }
+  }
+  /* their continuations were called when they were sent */
+  fail_messages (s, &s->retx_head, &s->retx_tail);
+  s->msgs_in_queue = 0;
+  s->bytes_in_queue = 0;
+  if (NULL != s->reassembly_task)
+  {
+    GNUNET_SCHEDULER_cancel (s->reassembly_task);
+    s->reassembly_task = NULL;
+  }
+  if (NULL != s->timeout_task)
+  {
+    GNUNET_SCHEDULER_cancel (s->timeout_task);
+    s->timeout_task = NULL;
+  }
+  if (0 != s->rtc_peer_connection)
+  {
+    peer_disconnect (s->rtc_peer_connection);
+    s->rtc_peer_connection = 0;
+  }
+  if (NULL != s->channel)
+  {
+    struct GNUNET_CADET_Channel *channel = s->channel;
+
+    /* our disconnect callback must not see the session any more */
+    s->channel = NULL;
+    GNUNET_CADET_channel_destroy (channel);
+  }
+  notify_session_monitor (plugin,
+                          s,
+                          GNUNET_TRANSPORT_SS_DONE);
+  if (NULL != s->msg_tk)
+  {
+    GNUNET_MST_destroy (s->msg_tk);
+    s->msg_tk = NULL;
+  }
+  GNUNET_HELLO_address_free (s->address);
+  GNUNET_free (s);
 }
 
 
@@ -214,10 +985,39 @@ webrtc_plugin_send (void *cls,
                     GNUNET_TRANSPORT_TransmitContinuation cont,
                     void *cont_cls)
 {
-  /*  struct Plugin *plugin = cls; */
-  ssize_t bytes_sent = 0;
+  const struct GNUNET_MessageHeader *hdr =
+    (const struct GNUNET_MessageHeader *) msgbuf;
+  struct WebRTCMessage *msg;
 
-  return bytes_sent;
+  if (msgbuf_size > UINT16_MAX)
+  {
+    GNUNET_break (0);
+    return -1;
+  }
+  msg = GNUNET_malloc (sizeof (struct WebRTCMessage) + msgbuf_size);
+  msg->size = msgbuf_size;
+  msg->transmit_cont = cont;
+  msg->transmit_cont_cls = cont_cls;
+  /* ids start at 1, 0 marks an unused slot in reasm_done */
+  msg->id = ++session->last_id;
+  msg->type = WEBRTC_FRAME_DATA;
+  msg->fragments = (1 << fragment_count (msgbuf_size)) - 1;
+  /* everything but CORE's encrypted traffic is signalling that should not
+     wait behind bulk data or get lost */
+  if ( (msgbuf_size >= sizeof (*hdr)) &&
+       (GNUNET_MESSAGE_TYPE_CORE_ENCRYPTED_MESSAGE == ntohs (hdr->type)) )
+    msg->channel = WEBRTC_CHANNEL_BULK;
+  else
+    msg->channel = WEBRTC_CHANNEL_CONTROL;
+  GNUNET_memcpy (&msg[1], msgbuf, msgbuf_size);
+  webrtc_count_copy (GNUNET_YES);
+  enqueue_message (session, msg);
+  flush_queue (session);
+  notify_session_monitor (session->plugin,
+                          session,
+                          GNUNET_TRANSPORT_SS_UPDATE);
+  return msgbuf_size + fragment_count (msgbuf_size)
+    * (sizeof (struct WebRTCFrameHeader) + WEBRTC_OVERHEAD);
 }
 
 
@@ -227,15 +1027,83 @@ webrtc_plugin_send (void *cls,
  * (and their continuationc).
  *
  * @param cls closure
- * @param target peer from which to disconnect
+ * @param session session from which to disconnect
+ * @return #GNUNET_OK on success
  */
-static void
-webrtc_plugin_disconnect_peer (void *cls,
-                               const struct GNUNET_PeerIdentity *target)
+static int
+webrtc_plugin_disconnect_session (void *cls,
+                                  struct GNUNET_ATS_Session *session)
 {
   struct Plugin *plugin = cls;
-  
-  GNUNET_break (0);
+
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+      "Disconnecting session %p to peer `%s'\n",
+      session,
+      GNUNET_i2s (&session->peer));
+  /* transport only learns about inbound sessions once they are up */
+  if ( (GNUNET_NO == session->is_inbound) ||
+       (WEBRTC_SESSION_UP == session->state) )
+    plugin->env->session_end (plugin->env->cls,
+                              session->address,
+                              session);
+  delete_session (session);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Session was idle for too long, so disconnect it.
+ *
+ * @param cls the `struct GNUNET_ATS_Session` of the idle session
+ */
+static void
+session_timeout (void *cls)
+{
+  struct GNUNET_ATS_Session *s = cls;
+
+  s->timeout_task = NULL;
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Session %p was idle for %s, disconnecting\n",
+       s,
+       GNUNET_STRINGS_relative_time_to_string (WEBRTC_SESSION_TIMEOUT,
+                                               GNUNET_YES));
+  GNUNET_assert (GNUNET_OK ==
+                 webrtc_plugin_disconnect_session (s->plugin, s));
+}
+
+
+/**
+ * Start or restart the idle timeout of a session.
+ *
+ * @param s the session
+ */
+static void
+reschedule_session_timeout (struct GNUNET_ATS_Session *s)
+{
+  if (NULL != s->timeout_task)
+    GNUNET_SCHEDULER_cancel (s->timeout_task);
+  s->timeout = GNUNET_TIME_relative_to_absolute (WEBRTC_SESSION_TIMEOUT);
+  s->timeout_task = GNUNET_SCHEDULER_add_delayed (WEBRTC_SESSION_TIMEOUT,
+                                                  &session_timeout,
+                                                  s);
+}
+
+
+/**
+ * Disconnect one session of a peer.
+ *
+ * @param cls the `struct Plugin *`
+ * @param peer identity of the peer
+ * @param value the `struct GNUNET_ATS_Session *`
+ * @return #GNUNET_OK (continue iterating)
+ */
+static int
+disconnect_session_cb (void *cls,
+                       const struct GNUNET_PeerIdentity *peer,
+                       void *value)
+{
+  webrtc_plugin_disconnect_session (cls, value);
+  return GNUNET_OK;
 }
 
 
@@ -245,17 +1113,18 @@ webrtc_plugin_disconnect_peer (void *cls,
  * (and their continuationc).
  *
  * @param cls closure
- * @param session session from which to disconnect
- * @return #GNUNET_OK on success
+ * @param target peer from which to disconnect
  */
-static int
-webrtc_plugin_disconnect_session (void *cls,
-                                  struct GNUNET_ATS_Session *session)
+static void
+webrtc_plugin_disconnect_peer (void *cls,
+                               const struct GNUNET_PeerIdentity *target)
 {
   struct Plugin *plugin = cls;
-  
-  GNUNET_break (0);
-  return GNUNET_SYSERR;
+
+  GNUNET_CONTAINER_multipeermap_get_multiple (plugin->sessions,
+                                              target,
+                                              &disconnect_session_cb,
+                                              plugin);
 }
 
 
@@ -441,29 +1310,518 @@ webrtc_plugin_string_to_address (void *cls,
 }
 
 
+static void
+process_sdp_queue (struct Plugin *plugin);
+
+
+/**
+ * Our offer was not answered in time.  Give its slot to the next waiting
+ * offer and drop the session; ATS asks for a new one if it still wants
+ * the peer.
+ *
+ * @param cls the session
+ */
+static void
+answer_timeout_cb (void *cls)
+{
+  struct GNUNET_ATS_Session *s = cls;
+  struct Plugin *plugin = s->plugin;
+
+  s->answer_task = NULL;
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+      "Peer `%s' did not answer our offer within %s\n",
+      GNUNET_i2s (&s->peer),
+      GNUNET_STRINGS_relative_time_to_string (WEBRTC_ANSWER_TIMEOUT,
+                                              GNUNET_YES));
+  GNUNET_STATISTICS_update (plugin->env->stats,
+                            "# webrtc offers not answered",
+                            1,
+                            GNUNET_NO);
+  webrtc_plugin_disconnect_session (plugin, s);
+  process_sdp_queue (plugin);
+}
+
+
+/**
+ * Task to drop stale SDPs from the queue.
+ *
+ * @param cls the plugin
+ */
+static void
+sdp_task_cb (void *cls)
+{
+  struct Plugin *plugin = cls;
+
+  plugin->sdp_task = NULL;
+  process_sdp_queue (plugin);
+}
+
+
+/**
+ * Send queued SDPs whose CADET channel has room in its window.  Offers
+ * also wait while #WEBRTC_OFFERS_MAX of ours are unanswered, so a burst of
+ * new sessions does not pile up in the CADET queues.  SDPs that waited
+ * longer than #WEBRTC_SDP_STALE are dropped with their session.
+ *
+ * @param plugin the plugin
+ */
+static void
+process_sdp_queue (struct Plugin *plugin)
+{
+  struct GNUNET_ATS_Session *s;
+  struct GNUNET_ATS_Session *next;
+  struct GNUNET_TIME_Relative delay;
+
+  for (s = plugin->sdp_head; NULL != s; s = next)
+  {
+    next = s->sdp_next;
+    delay = GNUNET_TIME_absolute_get_duration (s->sdp_queued);
+    if ( (NULL == s->channel) ||
+         (delay.rel_value_us >= WEBRTC_SDP_STALE.rel_value_us) )
+    {
+      LOG (GNUNET_ERROR_TYPE_DEBUG,
+          "Dropping stale %s for peer `%s'\n",
+          (GNUNET_YES == s->sdp_is_offer) ? "offer" : "answer",
+          GNUNET_i2s (&s->peer));
+      GNUNET_STATISTICS_update (plugin->env->stats,
+                                "# webrtc stale SDPs dropped",
+                                1,
+                                GNUNET_NO);
+      webrtc_plugin_disconnect_session (plugin, s);
+      continue;
+    }
+    if ( (0 >= s->window) ||
+         ( (GNUNET_YES == s->sdp_is_offer) &&
+           (WEBRTC_OFFERS_MAX <= plugin->offers_outstanding) ) )
+      continue;
+    GNUNET_CONTAINER_DLL_remove2 (plugin->sdp_head,
+                                  plugin->sdp_tail,
+                                  s,
+                                  sdp_next,
+                                  sdp_prev);
+    GNUNET_STATISTICS_update (plugin->env->stats,
+                              "# webrtc SDP queueing time (ms)",
+                              delay.rel_value_us / 1000LL,
+                              GNUNET_NO);
+    if (GNUNET_YES == s->sdp_is_offer)
+    {
+      s->offer_outstanding = GNUNET_YES;
+      plugin->offers_outstanding++;
+      s->answer_task = GNUNET_SCHEDULER_add_delayed (WEBRTC_ANSWER_TIMEOUT,
+                                                     &answer_timeout_cb,
+                                                     s);
+    }
+    s->window--;
+    GNUNET_MQ_send (GNUNET_CADET_get_mq (s->channel), s->sdp_env);
+    s->sdp_env = NULL;
+  }
+  if ( (NULL != plugin->sdp_head) &&
+       (NULL == plugin->sdp_task) )
+    plugin->sdp_task =
+      GNUNET_SCHEDULER_add_at (GNUNET_TIME_absolute_add (plugin->sdp_head->sdp_queued,
+                                                         WEBRTC_SDP_STALE),
+                               &sdp_task_cb,
+                               plugin);
+}
+
+
+/**
+ * Queue our offer or answer for the CADET channel.  It replaces one that
+ * is still waiting, which the page would only have sent us again if it
+ * was out of date.
+ *
+ * @param s the session
+ * @param env the offer or answer
+ * @param is_offer #GNUNET_YES if @a env is an offer
+ */
+static void
+queue_sdp (struct GNUNET_ATS_Session *s,
+           struct GNUNET_MQ_Envelope *env,
+           int is_offer)
+{
+  struct Plugin *plugin = s->plugin;
+
+  if (NULL != s->sdp_env)
+  {
+    GNUNET_STATISTICS_update (plugin->env->stats,
+                              "# webrtc stale SDPs replaced",
+                              1,
+                              GNUNET_NO);
+    GNUNET_CONTAINER_DLL_remove2 (plugin->sdp_head,
+                                  plugin->sdp_tail,
+                                  s,
+                                  sdp_next,
+                                  sdp_prev);
+    GNUNET_MQ_discard (s->sdp_env);
+  }
+  s->sdp_env = env;
+  s->sdp_is_offer = is_offer;
+  s->sdp_queued = GNUNET_TIME_absolute_get ();
+  GNUNET_CONTAINER_DLL_insert_tail2 (plugin->sdp_head,
+                                     plugin->sdp_tail,
+                                     s,
+                                     sdp_next,
+                                     sdp_prev);
+  process_sdp_queue (plugin);
+}
+
+
 static void
 offer_cb(void *cls,
          char *offer)
 {
   struct GNUNET_ATS_Session *s = cls;
-  struct GNUNET_MQ_Handle *mq = GNUNET_CADET_get_mq (s->channel);
   size_t offer_len = strlen (offer);
   struct GNUNET_MessageHeader *msg;
-  struct GNUNET_MQ_Envelope *env = GNUNET_MQ_msg_extra (msg, offer_len, MESSAGE_TYPE_WEBRTC_OFFER);
+  struct GNUNET_MQ_Envelope *env;
 
+  if (NULL == s->channel)
+  {
+    webrtc_plugin_disconnect_session (s->plugin, s);
+    return;
+  }
+  env = GNUNET_MQ_msg_extra (msg, offer_len, MESSAGE_TYPE_WEBRTC_OFFER);
   LOG (GNUNET_ERROR_TYPE_DEBUG,
-      "Sending our offer `%s'\n",
+      "Queueing our offer `%s'\n",
       offer);
   memcpy (&msg[1], offer, offer_len);
-  GNUNET_MQ_send (mq, env);
+  queue_sdp (s, env, GNUNET_YES);
+}
+
+
+/**
+ * Callback for message stream tokenizer
+ *
+ * @param cls the session
+ * @param message the message received
+ * @return always #GNUNET_OK
+ */
+static int
+message_mst_cb (void *cls,
+                const struct GNUNET_MessageHeader *message)
+{
+  struct GNUNET_ATS_Session *s = cls;
+  struct Plugin *plugin = s->plugin;
+  struct GNUNET_TIME_Relative delay;
+
+  delay = plugin->env->receive (plugin->env->cls,
+                                s->address,
+                                s,
+                                message);
+  GNUNET_STATISTICS_update (plugin->env->stats,
+                            "# bytes received via webrtc",
+                            ntohs (message->size),
+                            GNUNET_NO);
+  s->next_receive = GNUNET_TIME_relative_to_absolute (delay);
+  reschedule_session_timeout (s);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Pass a complete message to the transport service.  Whatever is left over
+ * at the end of it is dropped rather than joined to the next one.
+ *
+ * @param s the session
+ * @param buf the message
+ * @param size size of @a buf
+ */
+static void
+deliver_message (struct GNUNET_ATS_Session *s,
+                 const char *buf,
+                 size_t size)
+{
+  if (NULL == s->msg_tk)
+    s->msg_tk = GNUNET_MST_create (&message_mst_cb, s);
+  GNUNET_MST_from_buffer (s->msg_tk,
+                          buf,
+                          size,
+                          GNUNET_YES,
+                          GNUNET_NO);
+}
+
+
+/**
+ * Give up on a partially received message.
+ *
+ * @param s the session
+ * @param channel data channel of the message
+ * @param r the message
+ */
+static void
+drop_reassembly (struct GNUNET_ATS_Session *s,
+                 unsigned int channel,
+                 struct WebRTCReassembly *r)
+{
+  GNUNET_CONTAINER_DLL_remove (s->reasm_head[channel],
+                               s->reasm_tail[channel],
+                               r);
+  s->reasm_count[channel]--;
+  GNUNET_STATISTICS_update (s->plugin->env->stats,
+                            "# webrtc messages lost in reassembly",
+                            1,
+                            GNUNET_NO);
+  GNUNET_free (r);
+}
+
+
+/**
+ * Time out partially received messages and ask for the missing fragments
+ * of bulk messages.
+ *
+ * @param cls the session
+ */
+static void
+reassembly_task_cb (void *cls)
+{
+  struct GNUNET_ATS_Session *s = cls;
+  struct WebRTCReassembly *r;
+  struct WebRTCReassembly *next;
+  struct WebRTCMessage *msg;
+  struct GNUNET_TIME_Relative age;
+  unsigned int channel;
+  int pending;
+
+  s->reassembly_task = NULL;
+  pending = GNUNET_NO;
+  for (channel = 0; channel < WEBRTC_CHANNELS; channel++)
+  {
+    for (r = s->reasm_head[channel]; NULL != r; r = next)
+    {
+      next = r->next;
+      age = GNUNET_TIME_absolute_get_duration (r->start);
+      if (age.rel_value_us >= WEBRTC_REASSEMBLY_TIMEOUT.rel_value_us)
+      {
+        drop_reassembly (s, channel, r);
+        continue;
+      }
+      pending = GNUNET_YES;
+      /* only the bulk channel loses fragments */
+      if ( (GNUNET_YES != s->plugin->retransmit) ||
+           (WEBRTC_CHANNEL_BULK != channel) ||
+           (WEBRTC_NACK_MAX <= r->nacks) ||
+           (age.rel_value_us <
+            (r->nacks + 1) * WEBRTC_NACK_DELAY.rel_value_us) )
+        continue;
+      r->nacks++;
+      msg = GNUNET_new (struct WebRTCMessage);
+      msg->id = r->id;
+      msg->channel = WEBRTC_CHANNEL_CONTROL;
+      msg->type = WEBRTC_FRAME_NACK;
+      msg->fragments = r->missing;
+      enqueue_message (s, msg);
+    }
+  }
+  if (GNUNET_YES == pending)
+    s->reassembly_task = GNUNET_SCHEDULER_add_delayed (WEBRTC_NACK_DELAY,
+                                                       &reassembly_task_cb,
+                                                       s);
+  flush_queue (s);
+}
+
+
+/**
+ * A fragment of a message arrived.
+ *
+ * @param s the session
+ * @param channel data channel the fragment arrived on
+ * @param hdr frame header of the fragment
+ * @param payload the fragment
+ * @param len size of @a payload
+ */
+static void
+receive_fragment (struct GNUNET_ATS_Session *s,
+                  unsigned int channel,
+                  const struct WebRTCFrameHeader *hdr,
+                  const char *payload,
+                  size_t len)
+{
+  struct WebRTCReassembly *r;
+  uint32_t id = ntohl (hdr->id);
+  uint16_t size = ntohs (hdr->size);
+  size_t offset = hdr->fragment * WEBRTC_FRAGMENT_PAYLOAD;
+  unsigned int i;
+
+  if ( (hdr->fragment >= fragment_count (size)) ||
+       (len != GNUNET_MIN (WEBRTC_FRAGMENT_PAYLOAD, size - offset)) )
+  {
+    GNUNET_break_op (0);
+    return;
+  }
+  if (1 == fragment_count (size))
+  {
+    deliver_message (s, payload, len);
+    return;
+  }
+  for (r = s->reasm_head[channel]; NULL != r; r = r->next)
+    if (r->id == id)
+      break;
+  if (NULL == r)
+  {
+    /* a fragment resent after the message was complete */
+    for (i = 0; i < WEBRTC_REASSEMBLY_MAX; i++)
+      if (s->reasm_done[channel][i] == id)
+        return;
+    if (WEBRTC_REASSEMBLY_MAX == s->reasm_count[channel])
+      drop_reassembly (s, channel, s->reasm_head[channel]);
+    r = GNUNET_malloc (sizeof (struct WebRTCReassembly) + size);
+    r->start = GNUNET_TIME_absolute_get ();
+    r->id = id;
+    r->size = size;
+    r->missing = (1 << fragment_count (size)) - 1;
+    GNUNET_CONTAINER_DLL_insert_tail (s->reasm_head[channel],
+                                      s->reasm_tail[channel],
+                                      r);
+    s->reasm_count[channel]++;
+    if (NULL == s->reassembly_task)
+      s->reassembly_task = GNUNET_SCHEDULER_add_delayed (WEBRTC_NACK_DELAY,
+                                                         &reassembly_task_cb,
+                                                         s);
+  }
+  if (r->size != size)
+  {
+    GNUNET_break_op (0);
+    return;
+  }
+  if (0 == (r->missing & (1 << hdr->fragment)))
+    return; /* duplicate */
+  GNUNET_memcpy (((char *) &r[1]) + offset, payload, len);
+  webrtc_count_copy (GNUNET_NO);
+  r->missing &= ~(1 << hdr->fragment);
+  if (0 != r->missing)
+    return;
+  GNUNET_CONTAINER_DLL_remove (s->reasm_head[channel],
+                               s->reasm_tail[channel],
+                               r);
+  s->reasm_count[channel]--;
+  s->reasm_done[channel][s->reasm_done_next[channel]] = id;
+  s->reasm_done_next[channel] =
+    (s->reasm_done_next[channel] + 1) % WEBRTC_REASSEMBLY_MAX;
+  GNUNET_STATISTICS_update (s->plugin->env->stats,
+                            "# webrtc messages reassembled",
+                            1,
+                            GNUNET_NO);
+  deliver_message (s, (const char *) &r[1], r->size);
+  GNUNET_free (r);
+}
+
+
+/**
+ * A frame arrived on one of the data channels.
+ *
+ * @param cls the session
+ * @param channel the data channel, one of the WEBRTC_CHANNEL_* values
+ * @param data the frame
+ * @param length size of @a data
+ */
+static void
+message_cb(void *cls, int channel, uint8_t *data, int length)
+{
+  struct GNUNET_ATS_Session *s = cls;
+  const struct WebRTCFrameHeader *hdr =
+    (const struct WebRTCFrameHeader *) data;
+
+  if ( (WEBRTC_SESSION_UP != s->state) ||
+       (0 > channel) ||
+       (WEBRTC_CHANNELS <= channel) ||
+       (sizeof (*hdr) > length) )
+  {
+    GNUNET_break_op (0);
+    return;
+  }
+  switch (hdr->type)
+  {
+  case WEBRTC_FRAME_DATA:
+    receive_fragment (s,
+                      channel,
+                      hdr,
+                      (const char *) &hdr[1],
+                      length - sizeof (*hdr));
+    break;
+  case WEBRTC_FRAME_NACK:
+    handle_nack (s, ntohl (hdr->id), hdr->fragment);
+    break;
+  default:
+    GNUNET_break_op (0);
+  }
 }
 
 
+/**
+ * The page reports a change on the data channel.
+ *
+ * @param cls the session
+ * @param event one of the WEBRTC_EVENT_* values
+ * @param size for #WEBRTC_EVENT_SENT, size of the frame handed to the
+ *        data channel
+ * @param buffered bufferedAmount of the data channels together
+ */
 static void
-message_cb(void *cls, uint8_t *data, int length)
+event_cb (void *cls, int event, int size, int buffered)
 {
   struct GNUNET_ATS_Session *s = cls;
-  GNUNET_break (0);
+  struct Plugin *plugin = s->plugin;
+  struct WebRTCMessage *msg;
+  struct GNUNET_TIME_Relative delay;
+
+  switch (event)
+  {
+  case WEBRTC_EVENT_OPEN:
+    delay = GNUNET_TIME_absolute_get_duration (s->setup_start);
+    LOG (GNUNET_ERROR_TYPE_INFO,
+        "Data channel to peer `%s' is open after %s\n",
+        GNUNET_i2s (&s->peer),
+        GNUNET_STRINGS_relative_time_to_string (delay,
+                                                GNUNET_YES));
+    GNUNET_STATISTICS_update (plugin->env->stats,
+                              "# webrtc sessions set up",
+                              1,
+                              GNUNET_NO);
+    GNUNET_STATISTICS_update (plugin->env->stats,
+                              "# webrtc session setup time (ms)",
+                              delay.rel_value_us / 1000LL,
+                              GNUNET_NO);
+    s->state = WEBRTC_SESSION_UP;
+    if (GNUNET_YES == s->is_inbound)
+      plugin->env->session_start (plugin->env->cls,
+                                  s->address,
+                                  s,
+                                  GNUNET_NT_WAN);
+    notify_session_monitor (plugin, s, GNUNET_TRANSPORT_SS_UP);
+    flush_queue (s);
+    break;
+  case WEBRTC_EVENT_SENT:
+    /* frames reach the data channels in the order we sent them */
+    msg = s->sent_head;
+    if ( (NULL == msg) ||
+         (size > s->bytes_in_flight) )
+    {
+      GNUNET_break (0);
+      break;
+    }
+    s->bytes_in_flight -= size;
+    s->buffered = buffered;
+    GNUNET_STATISTICS_update (plugin->env->stats,
+                              "# bytes sent via webrtc",
+                              size,
+                              GNUNET_NO);
+    if (0 == --msg->fragments_pending)
+      message_sent (s, msg);
+    flush_queue (s);
+    break;
+  case WEBRTC_EVENT_BUFFERED:
+    s->buffered = buffered;
+    flush_queue (s);
+    break;
+  case WEBRTC_EVENT_CLOSE:
+    LOG (GNUNET_ERROR_TYPE_DEBUG,
+        "Data channel to peer `%s' closed\n",
+        GNUNET_i2s (&s->peer));
+    webrtc_plugin_disconnect_session (plugin, s);
+    break;
+  default:
+    GNUNET_break (0);
+  }
 }
 
 
@@ -483,9 +1841,6 @@ check_answer (void *cls,
 }
 
 
-extern void set_remote_answer(int, void *, int);
-
-
 /**
  * Functions with this signature are called whenever a complete answer
  * is received.
@@ -499,8 +1854,23 @@ handle_answer (void *cls,
 {
   struct GNUNET_ATS_Session *s = cls;
   uint16_t size = ntohs(message->size);
-  set_remote_answer(s->rtc_peer_connection, &message[1], size - sizeof(*message));
-  GNUNET_break (0);
+
+  GNUNET_CADET_receive_done (s->channel);
+  if (GNUNET_YES == s->offer_outstanding)
+  {
+    /* make room for the next waiting offer */
+    release_offer (s);
+    process_sdp_queue (s->plugin);
+  }
+  if (WEBRTC_SESSION_INIT != s->state)
+  {
+    GNUNET_break_op (0);
+    return;
+  }
+  set_remote_answer(s->rtc_peer_connection, (void *) &message[1],
+                    size - sizeof(*message));
+  s->state = WEBRTC_SESSION_HANDSHAKE;
+  notify_session_monitor (s->plugin, s, GNUNET_TRANSPORT_SS_HANDSHAKE);
 }
 
 
@@ -523,7 +1893,13 @@ out_window_change_cb (void *cls,
                       const struct GNUNET_CADET_Channel *channel,
                       int window_size)
 {
-  /* FIXME: could do flow control here... */
+  struct GNUNET_ATS_Session *s = cls;
+
+  if (NULL == s)
+    return;
+  s->window = window_size;
+  if (NULL != s->sdp_env)
+    process_sdp_queue (s->plugin);
 }
 
 
@@ -541,10 +1917,38 @@ out_disconnect_cb (void *cls,
 {
   struct GNUNET_ATS_Session *s = cls;
 
-  GNUNET_break (0);
+  if ( (NULL == s) ||
+       (NULL == s->channel) )
+    return;
+  s->channel = NULL;
+  /* once the data channel is up signalling is no longer needed */
+  if (WEBRTC_SESSION_UP != s->state)
+    webrtc_plugin_disconnect_session (s->plugin, s);
+}
+
+
+/**
+ * Locate the outbound session for a peer.
+ *
+ * @param cls where to store the session
+ * @param peer identity of the peer
+ * @param value a `struct GNUNET_ATS_Session *`
+ * @return #GNUNET_NO if found, #GNUNET_YES if not
+ */
+static int
+find_outbound_cb (void *cls,
+                  const struct GNUNET_PeerIdentity *peer,
+                  void *value)
+{
+  struct GNUNET_ATS_Session **ret = cls;
+  struct GNUNET_ATS_Session *s = value;
+
+  if (GNUNET_YES == s->is_inbound)
+    return GNUNET_YES;
+  *ret = s;
+  return GNUNET_NO;
 }
 
-extern int peer_connect(void *, void *, void *, void *, int, void *);
 
 /**
  * Create a new session to transmit data to the target
@@ -566,18 +1970,26 @@ webrtc_plugin_get_session (void *cls,
       "Trying to get session for peer `%s'\n",
       GNUNET_i2s (&address->peer));
   /* find existing session */
-  s = GNUNET_CONTAINER_multipeermap_get (plugin->sessions,
-                                         &address->peer);
+  s = NULL;
+  GNUNET_CONTAINER_multipeermap_get_multiple (plugin->sessions,
+                                              &address->peer,
+                                              &find_outbound_cb,
+                                              &s);
   if (NULL != s)
     return s;
   s = GNUNET_new (struct GNUNET_ATS_Session);
   s->plugin = plugin;
   s->peer = address->peer;
+  s->address = GNUNET_HELLO_address_copy (address);
+  s->is_inbound = GNUNET_NO;
+  s->state = WEBRTC_SESSION_INIT;
+  s->setup_start = GNUNET_TIME_absolute_get ();
+  reschedule_session_timeout (s);
   /* add new session */
   (void) GNUNET_CONTAINER_multipeermap_put (plugin->sessions,
                                             &s->peer,
                                             s,
-                                            GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_FAST);
+                                            GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE);
   struct GNUNET_MQ_MessageHandler handlers[] = {
     GNUNET_MQ_hd_var_size (answer,
                            MESSAGE_TYPE_WEBRTC_ANSWER,
@@ -593,24 +2005,33 @@ webrtc_plugin_get_session (void *cls,
                                             out_disconnect_cb,
                                             handlers);
   GNUNET_assert (s->channel != NULL);
-  s->rtc_peer_connection = peer_connect(offer_cb, NULL, message_cb, NULL, 0, s);
+  s->rtc_peer_connection = peer_connect(offer_cb, NULL, message_cb, event_cb,
+                                        NULL, 0, s);
   notify_session_monitor (plugin,
                           s,
                           GNUNET_TRANSPORT_SS_INIT);
-  return NULL;
+  return s;
 }
 
 
+/**
+ * Function that will be called whenever the transport service wants to
+ * notify the plugin that a session is still active and in use and
+ * therefore the session timeout for this session has to be updated
+ *
+ * @param cls closure
+ * @param peer which peer was the session for
+ * @param session which session is being updated
+ */
 static void
 webrtc_plugin_update_session_timeout (void *cls,
                                       const struct GNUNET_PeerIdentity *peer,
                                       struct GNUNET_ATS_Session *session)
 {
-
+  reschedule_session_timeout (session);
 }
 
 
-#if 0
 /**
  * Return information about the given session to the
  * monitor callback.
@@ -630,10 +2051,17 @@ send_session_info_iter (void *cls,
 
   notify_session_monitor (plugin,
                           session,
-                          GNUNET_TRANSPORT_SS_UP);
+                          GNUNET_TRANSPORT_SS_INIT);
+  if (WEBRTC_SESSION_HANDSHAKE == session->state)
+    notify_session_monitor (plugin,
+                            session,
+                            GNUNET_TRANSPORT_SS_HANDSHAKE);
+  else if (WEBRTC_SESSION_UP == session->state)
+    notify_session_monitor (plugin,
+                            session,
+                            GNUNET_TRANSPORT_SS_UP);
   return GNUNET_OK;
 }
-#endif
 
 
 /**
@@ -659,11 +2087,9 @@ webrtc_plugin_setup_monitor (void *cls,
   plugin->sic_cls = sic_cls;
   if (NULL != sic)
   {
-#if 0
-    GNUNET_CONTAINER_multipeermap_iterate (NULL /* FIXME */,
+    GNUNET_CONTAINER_multipeermap_iterate (plugin->sessions,
                                            &send_session_info_iter,
                                            plugin);
-#endif
     /* signal end of first iteration */
     sic (sic_cls, NULL, NULL);
   }
@@ -675,16 +2101,23 @@ answer_cb(void *cls,
           char *answer)
 {
   struct GNUNET_ATS_Session *s = cls;
-  struct GNUNET_MQ_Handle *mq = GNUNET_CADET_get_mq (s->channel);
   size_t answer_len = strlen (answer);
   struct GNUNET_MessageHeader *msg;
-  struct GNUNET_MQ_Envelope *env = GNUNET_MQ_msg_extra (msg, answer_len, MESSAGE_TYPE_WEBRTC_ANSWER);
+  struct GNUNET_MQ_Envelope *env;
 
+  if (NULL == s->channel)
+  {
+    webrtc_plugin_disconnect_session (s->plugin, s);
+    return;
+  }
+  env = GNUNET_MQ_msg_extra (msg, answer_len, MESSAGE_TYPE_WEBRTC_ANSWER);
   LOG (GNUNET_ERROR_TYPE_DEBUG,
-      "Sending our answer `%s'\n",
+      "Queueing our answer `%s'\n",
       answer);
   memcpy (&msg[1], answer, answer_len);
-  GNUNET_MQ_send (mq, env);
+  s->state = WEBRTC_SESSION_HANDSHAKE;
+  notify_session_monitor (s->plugin, s, GNUNET_TRANSPORT_SS_HANDSHAKE);
+  queue_sdp (s, env, GNUNET_NO);
 }
 
 /**
@@ -714,13 +2147,21 @@ static void
 handle_offer (void *cls,
               const struct GNUNET_MessageHeader *message)
 {
-  struct GNUNET_ATS_Session *s = cls; // XXX right?
+  struct GNUNET_ATS_Session *s = cls; /* channel context from connect_cb */
   LOG (GNUNET_ERROR_TYPE_DEBUG,
       "handle_offer called with session %p\n",
       s);
   uint16_t size = ntohs(message->size);
-  s->rtc_peer_connection = peer_connect(NULL, answer_cb, message_cb, &message[1], size - sizeof(*message), s);
-  GNUNET_break (0);
+
+  GNUNET_CADET_receive_done (s->channel);
+  if (0 != s->rtc_peer_connection)
+  {
+    GNUNET_break_op (0);
+    return;
+  }
+  s->rtc_peer_connection = peer_connect(NULL, answer_cb, message_cb, event_cb,
+                                        (void *) &message[1],
+                                        size - sizeof(*message), s);
 }
 
 
@@ -740,27 +2181,34 @@ connect_cb (void *cls,
 {
   struct Plugin *plugin = cls;
   struct GNUNET_ATS_Session *s;
+  uint32_t options = 0;
 
   LOG (GNUNET_ERROR_TYPE_DEBUG,
       "Got CADET connection from peer `%s'\n",
       GNUNET_i2s (initiator));
-  /* find existing session */
-  s = GNUNET_CONTAINER_multipeermap_get (plugin->sessions,
-                                         initiator);
-  if (NULL == s)
-  {
-    GNUNET_break (0);
-    return s;
-  }
+  /* inbound sessions are kept apart from any outbound one we opened, the
+     transport service copes with both */
   s = GNUNET_new (struct GNUNET_ATS_Session);
   s->plugin = plugin;
   s->peer = *initiator;
   s->channel = channel;
+  s->is_inbound = GNUNET_YES;
+  s->state = WEBRTC_SESSION_INIT;
+  s->setup_start = GNUNET_TIME_absolute_get ();
+  reschedule_session_timeout (s);
+  s->address = GNUNET_HELLO_address_allocate (initiator,
+                                              PLUGIN_NAME,
+                                              &options,
+                                              sizeof (options),
+                                              GNUNET_HELLO_ADDRESS_INFO_INBOUND);
   /* add new session */
   (void) GNUNET_CONTAINER_multipeermap_put (plugin->sessions,
                                             &s->peer,
                                             s,
-                                            GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_FAST);
+                                            GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE);
+  notify_session_monitor (plugin,
+                          s,
+                          GNUNET_TRANSPORT_SS_INIT);
   LOG (GNUNET_ERROR_TYPE_DEBUG,
       "Returning session %p\n",
       s);
@@ -780,7 +2228,7 @@ static void
 in_disconnect_cb (void *cls,
                   const struct GNUNET_CADET_Channel *channel)
 {
-  GNUNET_break (0);
+  out_disconnect_cb (cls, channel);
 }
 
 
@@ -803,7 +2251,7 @@ in_window_change_cb (void *cls,
                      const struct GNUNET_CADET_Channel *channel,
                      int window_size)
 {
-  /* FIXME: could do flow control here... */
+  out_window_change_cb (cls, channel, window_size);
 }
 
 
@@ -843,6 +2291,10 @@ libgnunet_plugin_transport_webrtc_init (void *cls)
                            plugin),
     GNUNET_MQ_handler_end ()
   };
+  plugin->retransmit =
+    GNUNET_CONFIGURATION_get_value_yesno (env->cfg,
+                                          "transport-webrtc",
+                                          "SELECTIVE_RETRANSMIT");
   GNUNET_CRYPTO_hash ("webrtc", 6, &plugin->port);
   plugin->in_port = GNUNET_CADET_open_port (plugin->cadet,
                                             &plugin->port,
@@ -892,6 +2344,21 @@ libgnunet_plugin_transport_webrtc_done (void *cls)
   struct GNUNET_TRANSPORT_PluginFunctions *api = cls;
   struct Plugin *plugin = api->cls;
 
+  if (NULL == plugin)
+  {
+    /* Stub shutdown */
+    GNUNET_free (api);
+    return NULL;
+  }
+  GNUNET_CONTAINER_multipeermap_iterate (plugin->sessions,
+                                         &disconnect_session_cb,
+                                         plugin);
+  GNUNET_CONTAINER_multipeermap_destroy (plugin->sessions);
+  if (NULL != plugin->sdp_task)
+  {
+    GNUNET_SCHEDULER_cancel (plugin->sdp_task);
+    plugin->sdp_task = NULL;
+  }
   GNUNET_CADET_close_port (plugin->in_port);
   GNUNET_CADET_disconnect (plugin->cadet);
   GNUNET_free (plugin);
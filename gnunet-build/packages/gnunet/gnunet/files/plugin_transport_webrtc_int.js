@@ -17,14 +17,141 @@
 mergeInto(LibraryManager.library, {
   $CONNECTIONS: [],
   $NEXT_CONNECTION: 1,
-  peer_connect__deps: ["$CONNECTIONS", "$NEXT_CONNECTION"],
-  peer_connect: function(offer_cb, answer_cb, message_cb, offer_ptr, offer_size, cls) {
+  // Data path counters, per direction.  copies counts the times a payload
+  // is copied: to or from the heap here, and in the heap by the plugin,
+  // into the queued message and each frame on the way out and into the
+  // reassembly buffer on the way in.  posts counts postMessage calls
+  // between worker and page, which move payloads by transfer.
+  $WEBRTC_STATS: {
+    interval: 10000,
+    timer: null,
+    in: {messages: 0, bytes: 0, copies: 0, posts: 0},
+    out: {messages: 0, bytes: 0, copies: 0, posts: 0},
+  },
+  $webrtc_stats_start__deps: ['$WEBRTC_STATS'],
+  $webrtc_stats_start: function() {
+    if (WEBRTC_STATS.timer) {
+      return;
+    }
+    WEBRTC_STATS.timer = setInterval(function() {
+      var seconds = WEBRTC_STATS.interval / 1000;
+      var report = {};
+      ['in', 'out'].forEach(function(dir) {
+        var d = WEBRTC_STATS[dir];
+        report[dir] = {
+          messages: d.messages,
+          bytes_per_s: Math.round(d.bytes / seconds),
+          copies_per_message: d.messages ? d.copies / d.messages : 0,
+          messages_per_post: d.posts ? d.messages / d.posts : 0};
+        WEBRTC_STATS[dir] = {messages: 0, bytes: 0, copies: 0, posts: 0};
+      });
+      if (report.in.messages || report.out.messages) {
+        console.debug('webrtc data path', JSON.stringify(report));
+      }
+    }, WEBRTC_STATS.interval);
+  },
+  // Called by the plugin for each payload copy it makes in the heap
+  webrtc_count_copy__deps: ['$WEBRTC_STATS'],
+  webrtc_count_copy: function(out) {
+    WEBRTC_STATS[out ? 'out' : 'in'].copies++;
+  },
+  $webrtc_buffered: function(channels) {
+    return channels.reduce(function(sum, dc) {
+      return sum + dc.bufferedAmount;
+    }, 0);
+  },
+  $webrtc_flush__deps: ['$WEBRTC_STATS', '$webrtc_buffered'],
+  $webrtc_flush: function(conn) {
+    var outbox = conn.outbox;
+    var indexes = conn.outbox_channels;
+    conn.outbox = [];
+    conn.outbox_channels = [];
+    WEBRTC_STATS.out.messages += outbox.length;
+    outbox.forEach(function(data) {
+      WEBRTC_STATS.out.bytes += data.byteLength;
+    });
+    if (conn.channels) {
+      // we own the data channels, no page round trip
+      for (var i = 0; i < outbox.length && !conn.closed; i++) {
+        var dc = conn.channels[indexes[i]];
+        if ('open' != dc.readyState) {
+          conn.event(4, 0, 0);
+          return;
+        }
+        dc.send(outbox[i]);
+        conn.event(2, outbox[i].byteLength, webrtc_buffered(conn.channels));
+      }
+    } else {
+      WEBRTC_STATS.out.posts++;
+      conn.port.postMessage({type: 'messages', data: outbox, channels: indexes},
+                            outbox);
+    }
+  },
+  peer_connect__deps: ['$CONNECTIONS', '$NEXT_CONNECTION', '$WEBRTC_STATS',
+                       '$webrtc_stats_start', '$webrtc_buffered'],
+  peer_connect: function(offer_cb, answer_cb, message_cb, event_cb, offer_ptr,
+                         offer_size, cls) {
     var offer;
     if (0 != offer_ptr) {
       offer = UTF8ToString(offer_ptr, offer_size);
     }
+    webrtc_stats_start();
     var channel = new MessageChannel();
     var port = channel.port1;
+    var receive = getFuncWrapper(message_cb, 'viiii');
+    var conn = {port: port, channels: null, outbox: [], outbox_channels: [],
+                closed: false};
+    // event codes understood by event_cb in plugin_transport_webrtc.c; the
+    // session is gone once the plugin called peer_disconnect
+    conn.event = function(code, size, buffered) {
+      if (conn.closed) {
+        return;
+      }
+      dynCall('viiii', event_cb, [cls, code, size, buffered]);
+    };
+    // index is the data channel's index in data-channel-configs in
+    // webrtc.cljs
+    var deliver = function(index, buffer) {
+      if (conn.closed) {
+        return;
+      }
+      var data = new Uint8Array(buffer);
+      WEBRTC_STATS.in.messages++;
+      WEBRTC_STATS.in.bytes += data.length;
+      WEBRTC_STATS.in.copies++;
+      ccallFunc(receive, 'void', ['number', 'number', 'array', 'number'],
+        [cls, index, data, data.length]);
+    };
+    // The page hands us the RTCDataChannels themselves where the browser
+    // can transfer them, then data never passes through the page
+    var adopt = function(channels) {
+      var opened = function() {
+        return channels.every(function(dc) {
+          return 'open' == dc.readyState;
+        });
+      };
+      conn.channels = channels;
+      channels.forEach(function(dc, index) {
+        dc.binaryType = 'arraybuffer';
+        dc.onopen = function() {
+          if (opened()) {
+            conn.event(1, 0, 0);
+          }
+        };
+        dc.onmessage = function(e) {
+          deliver(index, e.data);
+        };
+        dc.onbufferedamountlow = function() {
+          conn.event(3, 0, webrtc_buffered(channels));
+        };
+        dc.onclose = function() {
+          conn.event(4, 0, 0);
+        };
+      });
+      if (opened()) {
+        conn.event(1, 0, 0);
+      }
+    };
     port.onmessage = function(e) {
       if ('offer' == e.data.type && 0 != offer_cb) {
         ccallFunc(
@@ -38,8 +165,23 @@ mergeInto(LibraryManager.library, {
           'void',
           ['number', 'string'],
           [cls, e.data.sdp]);
-      } else if ('message' == e.data.type) {
-        console.error('got webrtc message:', e.data);
+      } else if ('messages' == e.data.type) {
+        WEBRTC_STATS.in.posts++;
+        e.data.data.forEach(function(buffer, i) {
+          deliver(e.data.channels[i], buffer);
+        });
+      } else if ('channels' == e.data.type) {
+        adopt(e.data.channels);
+      } else if ('open' == e.data.type) {
+        conn.event(1, 0, 0);
+      } else if ('sent' == e.data.type) {
+        e.data.sizes.forEach(function(size) {
+          conn.event(2, size, e.data.buffered);
+        });
+      } else if ('buffered' == e.data.type) {
+        conn.event(3, 0, e.data.buffered);
+      } else if ('close' == e.data.type) {
+        conn.event(4, 0, 0);
       } else {
         console.error('unhandled message on webrtc message channel', e.data);
       }
@@ -50,19 +192,46 @@ mergeInto(LibraryManager.library, {
         offer: offer,
         message_port: channel.port2}, [channel.port2]);
     });
-    CONNECTIONS[NEXT_CONNECTION] = port;
+    CONNECTIONS[NEXT_CONNECTION] = conn;
     return NEXT_CONNECTION++;
   },
-  set_remote_answer__deps: ["$CONNECTIONS"],
+  peer_send__deps: ['$CONNECTIONS', '$WEBRTC_STATS', '$webrtc_flush'],
+  peer_send: function(num, index, data_ptr, data_size) {
+    var conn = CONNECTIONS[num];
+    WEBRTC_STATS.out.copies++;
+    conn.outbox.push(HEAPU8.slice(data_ptr, data_ptr + data_size).buffer);
+    conn.outbox_channels.push(index);
+    // everything sent during this turn goes out together; this also keeps
+    // event_cb from running while the plugin is still inside peer_send
+    if (1 == conn.outbox.length) {
+      Promise.resolve().then(function() {
+        if (!conn.closed) {
+          webrtc_flush(conn);
+        }
+      });
+    }
+  },
+  set_remote_answer__deps: ['$CONNECTIONS'],
   set_remote_answer: function(num, answer_ptr, answer_size) {
-    var port = CONNECTIONS[num];
-    port.postMessage({type: 'answer', sdp: UTF8ToString(answer_ptr, answer_size)});
+    var conn = CONNECTIONS[num];
+    conn.port.postMessage({type: 'answer',
+                           sdp: UTF8ToString(answer_ptr, answer_size)});
   },
-  peer_disconnect__deps: ["$CONNECTIONS"],
+  peer_disconnect__deps: ['$CONNECTIONS'],
   peer_disconnect: function(num) {
-    var port = CONNECTIONS[num];
-    port.postMessage({type: 'disconnect'});
-    port.close();
+    var conn = CONNECTIONS[num];
+    if (!conn) {
+      return;
+    }
+    conn.closed = true;
+    if (conn.channels) {
+      conn.channels.forEach(function(dc) {
+        dc.onclose = null;
+        dc.close();
+      });
+    }
+    conn.port.postMessage({type: 'disconnect'});
+    conn.port.close();
     delete CONNECTIONS[num];
   }
 });
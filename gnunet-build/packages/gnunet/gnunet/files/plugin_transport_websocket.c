@@ -0,0 +1,1312 @@
+/*
+     This file is part of GNUnet
+     Copyright (C) 2026 GNUnet e.V.
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+
+/**
+ * @file transport/plugin_transport_websocket.c
+ * @brief WebSocket client transport plugin
+ * @author agent <agent@local>
+ *
+ * Each session is one binary WebSocket to the URL in the peer's address.
+ * Every GNUnet message is sent as its own WebSocket message; received
+ * WebSocket messages are fed through a tokenizer so the other end may
+ * batch several GNUnet messages into one.
+ */
+
+#include "platform.h"
+#include "gnunet_util_lib.h"
+#include "gnunet_protocols.h"
+#include "gnunet_statistics_service.h"
+#include "gnunet_transport_plugin.h"
+
+#define PLUGIN_NAME "websocket"
+#define LOG(kind,...) GNUNET_log_from (kind, PLUGIN_NAME, __VA_ARGS__)
+
+#define WEBSOCKET_STAT_STR_CONNECTIONS "# WebSocket connections"
+
+/**
+ * How long may a session be idle before we close it.
+ */
+#define WEBSOCKET_SESSION_TIMEOUT GNUNET_CONSTANTS_IDLE_CONNECTION_TIMEOUT
+
+/**
+ * Stop handing messages to the WebSocket while this many bytes are
+ * buffered in it.
+ */
+#define WEBSOCKET_HIGH_WATER (256 * 1024)
+
+/**
+ * WebSockets have no bufferedamountlow event, so this is how often we
+ * look at bufferedAmount while messages are held.
+ */
+#define WEBSOCKET_DRAIN_INTERVAL \
+  GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS, 20)
+
+
+GNUNET_NETWORK_STRUCT_BEGIN
+
+/**
+ * Address of a peer reachable over WebSocket.
+ */
+struct WebSocketAddress
+{
+  /**
+   * Address options, in NBO
+   */
+  uint32_t options GNUNET_PACKED;
+
+  /* followed by the 0-terminated ws:// or wss:// URL */
+};
+
+GNUNET_NETWORK_STRUCT_END
+
+
+/**
+ * Encapsulation of all of the state of the plugin.
+ */
+struct Plugin;
+
+
+/**
+ * Message waiting for the WebSocket to open or to drain.
+ */
+struct WebSocketMessage
+{
+  /**
+   * next pointer for double linked list
+   */
+  struct WebSocketMessage *next;
+
+  /**
+   * previous pointer for double linked list
+   */
+  struct WebSocketMessage *prev;
+
+  /**
+   * Continuation function to call once the message is sent, NULL if
+   * there is no continuation to call.
+   */
+  GNUNET_TRANSPORT_TransmitContinuation transmit_cont;
+
+  /**
+   * Closure for @e transmit_cont.
+   */
+  void *transmit_cont_cls;
+
+  /**
+   * message length
+   */
+  size_t size;
+
+  /* followed by the message */
+};
+
+
+/**
+ * Session handle for connections.
+ */
+struct GNUNET_ATS_Session
+{
+  /**
+   * Address
+   */
+  struct GNUNET_HELLO_Address *address;
+
+  /**
+   * Pointer to the global plugin struct.
+   */
+  struct Plugin *plugin;
+
+  /**
+   * Handle of the WebSocket
+   */
+  int ws;
+
+  /**
+   * #GNUNET_YES once the WebSocket is open
+   */
+  int is_open;
+
+  /**
+   * head of queue of messages waiting for the WebSocket to open or to
+   * drain
+   */
+  struct WebSocketMessage *msg_head;
+
+  /**
+   * tail of queue of messages waiting for the WebSocket to open or to
+   * drain
+   */
+  struct WebSocketMessage *msg_tail;
+
+  /**
+   * bufferedAmount of the WebSocket as last reported by the page
+   */
+  size_t buffered;
+
+  /**
+   * Message stream tokenizer for incoming data
+   */
+  struct GNUNET_MessageStreamTokenizer *msg_tk;
+
+  /**
+   * Session timeout task
+   */
+  struct GNUNET_SCHEDULER_Task *timeout_task;
+
+  /**
+   * Task resuming delivery of held messages at @e next_receive
+   */
+  struct GNUNET_SCHEDULER_Task *recv_wakeup_task;
+
+  /**
+   * Task sending queued messages once the WebSocket drains
+   */
+  struct GNUNET_SCHEDULER_Task *drain_task;
+
+  /**
+   * Absolute time when to receive data again
+   * Used for receive throttling
+   */
+  struct GNUNET_TIME_Absolute next_receive;
+
+  /**
+   * When does this session time out.
+   */
+  struct GNUNET_TIME_Absolute timeout;
+
+  /**
+   * Number of bytes waiting for transmission to this peer.
+   */
+  unsigned long long bytes_in_queue;
+
+  /**
+   * Number of messages waiting for transmission to this peer.
+   */
+  unsigned int msgs_in_queue;
+};
+
+
+/**
+ * Encapsulation of all of the state of the plugin.
+ */
+struct Plugin
+{
+  /**
+   * Our environment.
+   */
+  struct GNUNET_TRANSPORT_PluginEnvironment *env;
+
+  /**
+   * Open sessions.
+   */
+  struct GNUNET_CONTAINER_MultiPeerMap *sessions;
+
+  /**
+   * Function to call about session status changes.
+   */
+  GNUNET_TRANSPORT_SessionInfoCallback sic;
+
+  /**
+   * Closure for @e sic.
+   */
+  void *sic_cls;
+
+  /**
+   * Maximum number of WebSockets the plugin can use
+   */
+  unsigned int max_connections;
+
+  /**
+   * Current number of WebSockets
+   */
+  unsigned int cur_connections;
+};
+
+
+extern int websocket_connect_int(void *url, void *s, void *open_cb,
+    void *receive_cb, void *close_cb);
+extern int websocket_send_int(double ws, const void *data, double size);
+extern int websocket_buffered_int(double ws);
+extern void websocket_resume_int(double ws);
+extern void websocket_close_int(double ws);
+
+
+/**
+ * If a session monitor is attached, notify it about the new
+ * session state.
+ *
+ * @param plugin our plugin
+ * @param session session that changed state
+ * @param state new state of the session
+ */
+static void
+notify_session_monitor (struct Plugin *plugin,
+                        struct GNUNET_ATS_Session *session,
+                        enum GNUNET_TRANSPORT_SessionState state)
+{
+  struct GNUNET_TRANSPORT_SessionInfo info;
+
+  if (NULL == plugin->sic)
+    return;
+  memset (&info, 0, sizeof (info));
+  info.state = state;
+  info.is_inbound = GNUNET_NO;
+  info.num_msg_pending = session->msgs_in_queue;
+  info.num_bytes_pending = session->bytes_in_queue;
+  info.receive_delay = session->next_receive;
+  info.session_timeout = session->timeout;
+  info.address = session->address;
+  plugin->sic (plugin->sic_cls,
+               session,
+               &info);
+}
+
+
+/**
+ * Get the URL out of a WebSocket address.
+ *
+ * @param addr the address
+ * @param addrlen length of @a addr
+ * @return the URL, NULL if @a addr is malformed
+ */
+static const char *
+websocket_address_url (const void *addr,
+                       size_t addrlen)
+{
+  const char *url;
+
+  if ( (NULL == addr) ||
+       (addrlen <= sizeof (struct WebSocketAddress)) ||
+       ('\0' != ((const char *) addr)[addrlen - 1]) )
+    return NULL;
+  url = (const char *) addr + sizeof (struct WebSocketAddress);
+  if ( (0 != strncmp (url, "ws://", strlen ("ws://"))) &&
+       (0 != strncmp (url, "wss://", strlen ("wss://"))) )
+    return NULL;
+  return url;
+}
+
+
+/**
+ * Size of the framing a WebSocket client pays for a message: the
+ * header with its extended length and the masking key.
+ *
+ * @param size payload size
+ * @return framing size in bytes
+ */
+static size_t
+websocket_framing (size_t size)
+{
+  if (size < 126)
+    return 2 + 4;
+  if (size < 65536)
+    return 4 + 4;
+  return 10 + 4;
+}
+
+
+/**
+ * Delete session @a s
+ *
+ * @param s the session to delete
+ */
+static void
+websocket_delete_session (struct GNUNET_ATS_Session *s)
+{
+  struct Plugin *plugin = s->plugin;
+  struct WebSocketMessage *msg;
+
+  if (NULL != s->timeout_task)
+  {
+    GNUNET_SCHEDULER_cancel (s->timeout_task);
+    s->timeout_task = NULL;
+    s->timeout = GNUNET_TIME_UNIT_ZERO_ABS;
+  }
+  if (NULL != s->recv_wakeup_task)
+  {
+    GNUNET_SCHEDULER_cancel (s->recv_wakeup_task);
+    s->recv_wakeup_task = NULL;
+  }
+  if (NULL != s->drain_task)
+  {
+    GNUNET_SCHEDULER_cancel (s->drain_task);
+    s->drain_task = NULL;
+  }
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_multipeermap_remove (plugin->sessions,
+                                                       &s->address->peer,
+                                                       s));
+  while (NULL != (msg = s->msg_head))
+  {
+    GNUNET_CONTAINER_DLL_remove (s->msg_head, s->msg_tail, msg);
+    if (NULL != msg->transmit_cont)
+      msg->transmit_cont (msg->transmit_cont_cls,
+                          &s->address->peer,
+                          GNUNET_SYSERR,
+                          msg->size,
+                          0);
+    GNUNET_free (msg);
+  }
+  s->msgs_in_queue = 0;
+  s->bytes_in_queue = 0;
+  if (s->ws)
+  {
+    LOG (GNUNET_ERROR_TYPE_DEBUG,
+         "Session %p/WebSocket %d: closing connection to peer `%s'\n",
+         s, s->ws,
+         GNUNET_i2s (&s->address->peer));
+    GNUNET_assert (plugin->cur_connections > 0);
+    plugin->cur_connections--;
+    websocket_close_int(s->ws);
+    s->ws = 0;
+  }
+  GNUNET_STATISTICS_set (plugin->env->stats,
+                         WEBSOCKET_STAT_STR_CONNECTIONS,
+                         plugin->cur_connections,
+                         GNUNET_NO);
+  notify_session_monitor (plugin,
+                          s,
+                          GNUNET_TRANSPORT_SS_DONE);
+  if (NULL != s->msg_tk)
+  {
+    GNUNET_MST_destroy (s->msg_tk);
+    s->msg_tk = NULL;
+  }
+  GNUNET_HELLO_address_free (s->address);
+  GNUNET_free (s);
+}
+
+
+/**
+ * Increment session timeout due to activity for session @a s
+ *
+ * @param s the session
+ */
+static void
+websocket_reschedule_session_timeout (struct GNUNET_ATS_Session *s)
+{
+  GNUNET_assert (NULL != s->timeout_task);
+  s->timeout = GNUNET_TIME_relative_to_absolute (WEBSOCKET_SESSION_TIMEOUT);
+}
+
+
+/**
+ * Put a message on the WebSocket and report it as sent.  Only call this
+ * while the WebSocket has room, see websocket_flush_queue().
+ *
+ * @param s the open session
+ * @param msgbuf the message
+ * @param msgbuf_size number of bytes in @a msgbuf
+ * @param cont continuation to call, can be NULL
+ * @param cont_cls closure for @a cont
+ * @return number of bytes used on the wire
+ */
+static size_t
+websocket_transmit (struct GNUNET_ATS_Session *s,
+                    const char *msgbuf,
+                    size_t msgbuf_size,
+                    GNUNET_TRANSPORT_TransmitContinuation cont,
+                    void *cont_cls)
+{
+  size_t physical = msgbuf_size + websocket_framing (msgbuf_size);
+
+  s->buffered = websocket_send_int(s->ws, msgbuf, msgbuf_size);
+  GNUNET_STATISTICS_update (s->plugin->env->stats,
+                            "# bytes sent via websocket",
+                            msgbuf_size,
+                            GNUNET_NO);
+  if (NULL != cont)
+    cont (cont_cls,
+          &s->address->peer,
+          GNUNET_OK,
+          msgbuf_size,
+          physical);
+  return physical;
+}
+
+
+/**
+ * Hand queued messages to the WebSocket while it has room, and look
+ * again later if some are left.
+ *
+ * @param s the open session
+ */
+static void
+websocket_flush_queue (struct GNUNET_ATS_Session *s);
+
+
+/**
+ * Time to see whether the WebSocket drained.
+ *
+ * @param cls the session
+ */
+static void
+websocket_drain (void *cls)
+{
+  struct GNUNET_ATS_Session *s = cls;
+
+  s->drain_task = NULL;
+  s->buffered = websocket_buffered_int(s->ws);
+  websocket_flush_queue (s);
+}
+
+
+static void
+websocket_flush_queue (struct GNUNET_ATS_Session *s)
+{
+  struct WebSocketMessage *msg;
+
+  while ( (NULL != (msg = s->msg_head)) &&
+          (s->buffered < WEBSOCKET_HIGH_WATER) )
+  {
+    GNUNET_CONTAINER_DLL_remove (s->msg_head, s->msg_tail, msg);
+    s->msgs_in_queue--;
+    s->bytes_in_queue -= msg->size;
+    websocket_transmit (s, (const char *) &msg[1], msg->size,
+                        msg->transmit_cont, msg->transmit_cont_cls);
+    GNUNET_free (msg);
+  }
+  if ( (NULL != s->msg_head) &&
+       (NULL == s->drain_task) )
+    s->drain_task = GNUNET_SCHEDULER_add_delayed (WEBSOCKET_DRAIN_INTERVAL,
+                                                  &websocket_drain,
+                                                  s);
+  notify_session_monitor (s->plugin,
+                          s,
+                          GNUNET_TRANSPORT_SS_UPDATE);
+}
+
+
+/**
+ * Function that can be used by the transport service to transmit
+ * a message using the plugin.   Note that in the case of a
+ * peer disconnecting, the continuation MUST be called
+ * prior to the disconnect notification itself.  This function
+ * will be called with this peer's HELLO message to initiate
+ * a fresh connection to another peer.
+ *
+ * @param cls closure
+ * @param s which session must be used
+ * @param msgbuf the message to transmit
+ * @param msgbuf_size number of bytes in @a msgbuf
+ * @param priority how important is the message (most plugins will
+ *                 ignore message priority and just FIFO)
+ * @param to how long to wait at most for the transmission (does not
+ *                require plugins to discard the message after the timeout,
+ *                just advisory for the desired delay; most plugins will ignore
+ *                this as well)
+ * @param cont continuation to call once the message has
+ *        been transmitted (or if the transport is ready
+ *        for the next transmission call; or if the
+ *        peer disconnected...); can be NULL
+ * @param cont_cls closure for cont
+ * @return number of bytes used (on the physical network, with overheads);
+ *         -1 on hard errors (i.e. address invalid); 0 is a legal value
+ *         and does NOT mean that the message was not transmitted (DV)
+ */
+static ssize_t
+websocket_plugin_send (void *cls,
+                       struct GNUNET_ATS_Session *s,
+                       const char *msgbuf,
+                       size_t msgbuf_size,
+                       unsigned int priority,
+                       struct GNUNET_TIME_Relative to,
+                       GNUNET_TRANSPORT_TransmitContinuation cont,
+                       void *cont_cls)
+{
+  struct WebSocketMessage *msg;
+
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Session %p: Sending message with %llu to peer `%s'\n",
+       s,
+       (unsigned long long) msgbuf_size, GNUNET_i2s (&s->address->peer));
+  if ( (GNUNET_YES == s->is_open) &&
+       (NULL == s->msg_head) &&
+       (s->buffered < WEBSOCKET_HIGH_WATER) )
+    return websocket_transmit (s, msgbuf, msgbuf_size, cont, cont_cls);
+  msg = GNUNET_malloc (sizeof (struct WebSocketMessage) + msgbuf_size);
+  msg->size = msgbuf_size;
+  msg->transmit_cont = cont;
+  msg->transmit_cont_cls = cont_cls;
+  GNUNET_memcpy (&msg[1], msgbuf, msgbuf_size);
+  GNUNET_CONTAINER_DLL_insert_tail (s->msg_head, s->msg_tail, msg);
+  s->msgs_in_queue++;
+  s->bytes_in_queue += msgbuf_size;
+  if ( (GNUNET_YES == s->is_open) &&
+       (NULL == s->drain_task) )
+    s->drain_task = GNUNET_SCHEDULER_add_delayed (WEBSOCKET_DRAIN_INTERVAL,
+                                                  &websocket_drain,
+                                                  s);
+  notify_session_monitor (s->plugin,
+                          s,
+                          GNUNET_TRANSPORT_SS_UPDATE);
+  return msgbuf_size + websocket_framing (msgbuf_size);
+}
+
+
+/**
+ * Disconnect a session
+ *
+ * @param cls the `struct Plugin *`
+ * @param s session
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR on error
+ */
+static int
+websocket_plugin_session_disconnect (void *cls,
+                                     struct GNUNET_ATS_Session *s)
+{
+  struct Plugin *plugin = cls;
+
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Session %p: notifying transport about ending session\n", s);
+  plugin->env->session_end (plugin->env->cls,
+                            s->address,
+                            s);
+  websocket_delete_session (s);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Function that is called to get the keepalive factor.
+ * #GNUNET_CONSTANTS_IDLE_CONNECTION_TIMEOUT is divided by this number to
+ * calculate the interval between keepalive packets.
+ *
+ * @param cls closure with the `struct Plugin`
+ * @return keepalive factor
+ */
+static unsigned int
+websocket_plugin_query_keepalive_factor (void *cls)
+{
+  return 3;
+}
+
+
+/**
+ * Callback to destroys all sessions on exit.
+ *
+ * @param cls the `struct Plugin *`
+ * @param peer identity of the peer
+ * @param value the `struct GNUNET_ATS_Session *`
+ * @return #GNUNET_OK (continue iterating)
+ */
+static int
+destroy_session_cb (void *cls,
+                    const struct GNUNET_PeerIdentity *peer,
+                    void *value)
+{
+  struct Plugin *plugin = cls;
+  struct GNUNET_ATS_Session *session = value;
+
+  websocket_plugin_session_disconnect (plugin, session);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Function that can be used to force the plugin to disconnect
+ * from the given peer and cancel all previous transmissions
+ * (and their continuationc).
+ *
+ * @param cls closure
+ * @param target peer from which to disconnect
+ */
+static void
+websocket_plugin_peer_disconnect (void *cls,
+                                  const struct GNUNET_PeerIdentity *target)
+{
+  struct Plugin *plugin = cls;
+
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Transport tells me to disconnect `%s'\n",
+       GNUNET_i2s (target));
+  GNUNET_CONTAINER_multipeermap_get_multiple (plugin->sessions,
+                                              target,
+                                              &destroy_session_cb,
+                                              plugin);
+}
+
+
+/**
+ * Closure for #session_lookup_by_address().
+ */
+struct SessionCtx
+{
+  /**
+   * Address we are looking for.
+   */
+  const struct GNUNET_HELLO_Address *address;
+
+  /**
+   * Session that was found.
+   */
+  struct GNUNET_ATS_Session *ret;
+};
+
+
+/**
+ * Locate the session object for a given address.
+ *
+ * @param cls the `struct SessionCtx *`
+ * @param key peer identity
+ * @param value the `struct GNUNET_ATS_Session` to check
+ * @return #GNUNET_NO if found, #GNUNET_OK if not
+ */
+static int
+session_lookup_by_address (void *cls,
+                           const struct GNUNET_PeerIdentity *key,
+                           void *value)
+{
+  struct SessionCtx *sc_ctx = cls;
+  struct GNUNET_ATS_Session *s = value;
+
+  if (0 == GNUNET_HELLO_address_cmp (sc_ctx->address,
+                                     s->address))
+  {
+    sc_ctx->ret = s;
+    return GNUNET_NO;
+  }
+  return GNUNET_YES;
+}
+
+
+/**
+ * Callback for message stream tokenizer
+ *
+ * @param cls the session
+ * @param message the message received
+ * @return always #GNUNET_OK
+ */
+static int
+websocket_receive_mst_cb (void *cls,
+                          const struct GNUNET_MessageHeader *message)
+{
+  struct GNUNET_ATS_Session *s = cls;
+  struct Plugin *plugin = s->plugin;
+  struct GNUNET_TIME_Relative delay;
+
+  delay = plugin->env->receive (plugin->env->cls,
+                                s->address,
+                                s,
+                                message);
+  GNUNET_STATISTICS_update (plugin->env->stats,
+                            "# bytes received via websocket",
+                            ntohs (message->size),
+                            GNUNET_NO);
+  s->next_receive = GNUNET_TIME_relative_to_absolute (delay);
+  websocket_reschedule_session_timeout (s);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Inbound bandwidth is available again, let the WebSocket hand us the
+ * messages it is holding.
+ *
+ * @param cls the session
+ */
+static void
+websocket_wake_up (void *cls)
+{
+  struct GNUNET_ATS_Session *s = cls;
+
+  s->recv_wakeup_task = NULL;
+  if (s->ws)
+    websocket_resume_int(s->ws);
+}
+
+
+/**
+ * Called with each message received on the WebSocket.  Forward to MST.
+ *
+ * @param data the received message
+ * @param size size of an individual element
+ * @param nmemb count of elements in @a data
+ * @param cls the session
+ * @return bytes taken, 0 to make the WebSocket hold the message until
+ *         we wake it up
+ */
+static size_t
+websocket_receive (void *data,
+                   size_t size,
+                   size_t nmemb,
+                   void *cls)
+{
+  struct GNUNET_ATS_Session *s = cls;
+  size_t len = size * nmemb;
+  struct GNUNET_TIME_Relative delta;
+
+  delta = GNUNET_TIME_absolute_get_remaining (s->next_receive);
+  if (0 != delta.rel_value_us)
+  {
+    LOG (GNUNET_ERROR_TYPE_DEBUG,
+         "Session %p/WebSocket %d: No inbound bandwidth available! Next read was delayed for %s\n",
+         s, s->ws,
+         GNUNET_STRINGS_relative_time_to_string (delta,
+                                                 GNUNET_YES));
+    if (NULL == s->recv_wakeup_task)
+      s->recv_wakeup_task = GNUNET_SCHEDULER_add_delayed (delta,
+                                                          &websocket_wake_up,
+                                                          s);
+    return 0;
+  }
+  if (NULL == s->msg_tk)
+    s->msg_tk = GNUNET_MST_create (&websocket_receive_mst_cb,
+                                   s);
+  GNUNET_MST_from_buffer (s->msg_tk,
+                          data,
+                          len,
+                          GNUNET_NO,
+                          GNUNET_NO);
+  return len;
+}
+
+
+/**
+ * The WebSocket is open, send what was queued meanwhile.
+ *
+ * @param cls the session
+ */
+static void
+websocket_open_cb (void *cls)
+{
+  struct GNUNET_ATS_Session *s = cls;
+
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Session %p/WebSocket %d: connected to peer `%s'\n",
+       s, s->ws,
+       GNUNET_i2s (&s->address->peer));
+  s->is_open = GNUNET_YES;
+  websocket_flush_queue (s);
+  notify_session_monitor (s->plugin,
+                          s,
+                          GNUNET_TRANSPORT_SS_UP);
+}
+
+
+/**
+ * The WebSocket failed or was closed by the other end.
+ *
+ * @param cls the session
+ */
+static void
+websocket_close_cb (void *cls)
+{
+  struct GNUNET_ATS_Session *s = cls;
+
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Session %p/WebSocket %d: closed by peer `%s'\n",
+       s, s->ws,
+       GNUNET_i2s (&s->address->peer));
+  GNUNET_assert (s->plugin->cur_connections > 0);
+  s->plugin->cur_connections--;
+  s->ws = 0;
+  websocket_plugin_session_disconnect (s->plugin, s);
+}
+
+
+/**
+ * Function obtain the network type for a session
+ *
+ * @param cls closure (`struct Plugin*`)
+ * @param session the session
+ * @return the network type
+ */
+static enum GNUNET_NetworkType
+websocket_plugin_get_network (void *cls,
+                              struct GNUNET_ATS_Session *session)
+{
+  return GNUNET_NT_WAN;
+}
+
+
+/**
+ * Function obtain the network type for an address.
+ *
+ * @param cls closure (`struct Plugin *`)
+ * @param address the address
+ * @return the network type
+ */
+static enum GNUNET_NetworkType
+websocket_plugin_get_network_for_address (void *cls,
+                                          const struct GNUNET_HELLO_Address *address)
+{
+  return GNUNET_NT_WAN;
+}
+
+
+/**
+ * Session was idle, so disconnect it
+ *
+ * @param cls the `struct GNUNET_ATS_Session` of the idle session
+ */
+static void
+websocket_session_timeout (void *cls)
+{
+  struct GNUNET_ATS_Session *s = cls;
+  struct GNUNET_TIME_Relative left;
+
+  s->timeout_task = NULL;
+  left = GNUNET_TIME_absolute_get_remaining (s->timeout);
+  if (0 != left.rel_value_us)
+  {
+    /* not actually our turn yet, but let's at least update
+       the monitor, it may think we're about to die ... */
+    notify_session_monitor (s->plugin,
+                            s,
+                            GNUNET_TRANSPORT_SS_UPDATE);
+    s->timeout_task = GNUNET_SCHEDULER_add_delayed (left,
+                                                    &websocket_session_timeout,
+                                                    s);
+    return;
+  }
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Session %p was idle for %s, disconnecting\n",
+       s,
+       GNUNET_STRINGS_relative_time_to_string (WEBSOCKET_SESSION_TIMEOUT,
+                                               GNUNET_YES));
+  GNUNET_assert (GNUNET_OK ==
+                 websocket_plugin_session_disconnect (s->plugin, s));
+}
+
+
+/**
+ * Creates a new outbound session the transport service will use to
+ * send data to the peer
+ *
+ * @param cls the plugin
+ * @param address the address
+ * @return the session or NULL of max connections exceeded
+ */
+static struct GNUNET_ATS_Session *
+websocket_plugin_get_session (void *cls,
+                              const struct GNUNET_HELLO_Address *address)
+{
+  struct Plugin *plugin = cls;
+  struct GNUNET_ATS_Session *s;
+  struct SessionCtx sc_ctx;
+  const char *url;
+
+  url = websocket_address_url (address->address, address->address_length);
+  if (NULL == url)
+  {
+    GNUNET_break_op (0);
+    return NULL;
+  }
+  /* find existing session */
+  sc_ctx.address = address;
+  sc_ctx.ret = NULL;
+  GNUNET_CONTAINER_multipeermap_iterate (plugin->sessions,
+                                         &session_lookup_by_address,
+                                         &sc_ctx);
+  if (NULL != sc_ctx.ret)
+    return sc_ctx.ret;
+  if (plugin->max_connections <= plugin->cur_connections)
+  {
+    LOG (GNUNET_ERROR_TYPE_WARNING,
+         "Maximum number of connections (%u) reached: "
+         "cannot connect to peer `%s'\n",
+         plugin->max_connections,
+         GNUNET_i2s (&address->peer));
+    return NULL;
+  }
+  s = GNUNET_new (struct GNUNET_ATS_Session);
+  s->plugin = plugin;
+  s->address = GNUNET_HELLO_address_copy (address);
+  s->is_open = GNUNET_NO;
+  s->ws = websocket_connect_int((void *) url, s, &websocket_open_cb,
+                                &websocket_receive, &websocket_close_cb);
+  if (0 == s->ws)
+  {
+    LOG (GNUNET_ERROR_TYPE_WARNING,
+         "Cannot open a WebSocket to `%s' for peer `%s'\n",
+         url,
+         GNUNET_i2s (&address->peer));
+    GNUNET_HELLO_address_free (s->address);
+    GNUNET_free (s);
+    return NULL;
+  }
+  s->timeout = GNUNET_TIME_relative_to_absolute (WEBSOCKET_SESSION_TIMEOUT);
+  s->timeout_task = GNUNET_SCHEDULER_add_delayed (WEBSOCKET_SESSION_TIMEOUT,
+                                                  &websocket_session_timeout,
+                                                  s);
+  (void) GNUNET_CONTAINER_multipeermap_put (plugin->sessions,
+                                            &s->address->peer,
+                                            s,
+                                            GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE);
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Initiating outbound session %p to peer `%s' using `%s'\n",
+       s,
+       GNUNET_i2s (&s->address->peer),
+       url);
+  plugin->cur_connections++;
+  GNUNET_STATISTICS_set (plugin->env->stats,
+                         WEBSOCKET_STAT_STR_CONNECTIONS,
+                         plugin->cur_connections,
+                         GNUNET_NO);
+  notify_session_monitor (plugin,
+                          s,
+                          GNUNET_TRANSPORT_SS_INIT);
+  return s;
+}
+
+
+/**
+ * Another peer has suggested an address for this
+ * peer and transport plugin.  Check that this could be a valid
+ * address.  If so, consider adding it to the list
+ * of addresses.
+ *
+ * @param cls closure with the `struct Plugin`
+ * @param addr pointer to the address
+ * @param addrlen length of @a addr
+ * @return #GNUNET_OK if this is a plausible address for this peer
+ *         and transport; always returns #GNUNET_NO (this is the client!)
+ */
+static int
+websocket_plugin_address_suggested (void *cls,
+                                    const void *addr,
+                                    size_t addrlen)
+{
+  /* A WebSocket client does not have any valid address so:*/
+  return GNUNET_NO;
+}
+
+
+/**
+ * Function called for a quick conversion of the binary address to
+ * a numeric address.  Note that the caller must not free the
+ * address and that the next call to this function is allowed
+ * to override the address again.
+ *
+ * @param cls closure
+ * @param addr binary address
+ * @param addrlen length of the address
+ * @return string representing the same address
+ */
+static const char *
+websocket_plugin_address_to_string (void *cls,
+                                    const void *addr,
+                                    size_t addrlen)
+{
+  static char *buf;
+  const char *url = websocket_address_url (addr, addrlen);
+
+  if (NULL == url)
+  {
+    LOG (GNUNET_ERROR_TYPE_WARNING,
+         _("Unexpected address length: %u bytes\n"),
+         (unsigned int) addrlen);
+    return NULL;
+  }
+  GNUNET_free_non_null (buf);
+  GNUNET_asprintf (&buf,
+                   "%s.%u.%s",
+                   PLUGIN_NAME,
+                   ntohl (((const struct WebSocketAddress *) addr)->options),
+                   url);
+  return buf;
+}
+
+
+/**
+ * Convert the transports address to a nice, human-readable
+ * format.
+ *
+ * @param cls closure
+ * @param type name of the transport that generated the address
+ * @param addr one of the addresses of the host, NULL for the last address
+ *        the specific address format depends on the transport
+ * @param addrlen length of the address
+ * @param numeric should (IP) addresses be displayed in numeric form?
+ * @param timeout after how long should we give up?
+ * @param asc function to call on each string
+ * @param asc_cls closure for @a asc
+ */
+static void
+websocket_plugin_address_pretty_printer (void *cls, const char *type,
+                                         const void *addr, size_t addrlen,
+                                         int numeric,
+                                         struct GNUNET_TIME_Relative timeout,
+                                         GNUNET_TRANSPORT_AddressStringCallback
+                                         asc, void *asc_cls)
+{
+  const char *str = websocket_plugin_address_to_string (cls, addr, addrlen);
+
+  if (NULL == str)
+  {
+    asc (asc_cls, NULL, GNUNET_SYSERR); /* invalid address */
+  }
+  else
+  {
+    asc (asc_cls, str, GNUNET_OK); /* return address */
+  }
+  asc (asc_cls, NULL, GNUNET_OK); /* done */
+}
+
+
+/**
+ * Function called to convert a string address to
+ * a binary address.
+ *
+ * @param cls closure ('struct Plugin*')
+ * @param addr string address of the form "websocket.OPTIONS.URL"
+ * @param addrlen length of the @a addr
+ * @param buf location to store the buffer
+ * @param added location to store the number of bytes in the buffer.
+ *        If the function returns #GNUNET_SYSERR, its contents are undefined.
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR on failure
+ */
+static int
+websocket_plugin_string_to_address (void *cls,
+                                    const char *addr,
+                                    uint16_t addrlen,
+                                    void **buf, size_t *added)
+{
+  struct WebSocketAddress *wa;
+  const char *options;
+  const char *url;
+  size_t url_len;
+
+  if ( (NULL == addr) ||
+       (0 == addrlen) ||
+       ('\0' != addr[addrlen - 1]) ||
+       (strlen (addr) != addrlen - 1) )
+  {
+    GNUNET_break (0);
+    return GNUNET_SYSERR;
+  }
+  options = strchr (addr, '.');
+  if (NULL == options)
+  {
+    GNUNET_break (0);
+    return GNUNET_SYSERR;
+  }
+  options++;
+  url = strchr (options, '.');
+  if (NULL == url)
+  {
+    GNUNET_break (0);
+    return GNUNET_SYSERR;
+  }
+  url++;
+  url_len = strlen (url) + 1;
+  wa = GNUNET_malloc (sizeof (struct WebSocketAddress) + url_len);
+  wa->options = htonl (atol (options));
+  GNUNET_memcpy (&wa[1], url, url_len);
+  if (NULL == websocket_address_url (wa, sizeof (*wa) + url_len))
+  {
+    GNUNET_free (wa);
+    GNUNET_break (0);
+    return GNUNET_SYSERR;
+  }
+  *buf = wa;
+  *added = sizeof (*wa) + url_len;
+  return GNUNET_OK;
+}
+
+
+/**
+ * Function that will be called whenever the transport service wants to
+ * notify the plugin that a session is still active and in use and
+ * therefore the session timeout for this session has to be updated
+ *
+ * @param cls closure
+ * @param peer which peer was the session for
+ * @param session which session is being updated
+ */
+static void
+websocket_plugin_update_session_timeout (void *cls,
+                                         const struct GNUNET_PeerIdentity *peer,
+                                         struct GNUNET_ATS_Session *session)
+{
+  websocket_reschedule_session_timeout (session);
+}
+
+
+/**
+ * Function that will be called whenever the transport service wants to
+ * notify the plugin that the inbound quota changed and that the plugin
+ * should update it's delay for the next receive value
+ *
+ * @param cls closure
+ * @param peer which peer was the session for
+ * @param s which session is being updated
+ * @param delay new delay to use for receiving
+ */
+static void
+websocket_plugin_update_inbound_delay (void *cls,
+                                       const struct GNUNET_PeerIdentity *peer,
+                                       struct GNUNET_ATS_Session *s,
+                                       struct GNUNET_TIME_Relative delay)
+{
+  s->next_receive = GNUNET_TIME_relative_to_absolute (delay);
+  if (NULL != s->recv_wakeup_task)
+  {
+    /* messages are being held, deliver them at the new time */
+    GNUNET_SCHEDULER_cancel (s->recv_wakeup_task);
+    s->recv_wakeup_task = GNUNET_SCHEDULER_add_delayed (delay,
+                                                        &websocket_wake_up,
+                                                        s);
+  }
+}
+
+
+/**
+ * Return information about the given session to the
+ * monitor callback.
+ *
+ * @param cls the `struct Plugin` with the monitor callback (`sic`)
+ * @param peer peer we send information about
+ * @param value our `struct GNUNET_ATS_Session` to send information about
+ * @return #GNUNET_OK (continue to iterate)
+ */
+static int
+send_session_info_iter (void *cls,
+                        const struct GNUNET_PeerIdentity *peer,
+                        void *value)
+{
+  struct Plugin *plugin = cls;
+  struct GNUNET_ATS_Session *session = value;
+
+  notify_session_monitor (plugin,
+                          session,
+                          GNUNET_TRANSPORT_SS_INIT);
+  if (GNUNET_YES == session->is_open)
+    notify_session_monitor (plugin,
+                            session,
+                            GNUNET_TRANSPORT_SS_UP);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Begin monitoring sessions of a plugin.  There can only
+ * be one active monitor per plugin (i.e. if there are
+ * multiple monitors, the transport service needs to
+ * multiplex the generated events over all of them).
+ *
+ * @param cls closure of the plugin
+ * @param sic callback to invoke, NULL to disable monitor;
+ *            plugin will being by iterating over all active
+ *            sessions immediately and then enter monitor mode
+ * @param sic_cls closure for @a sic
+ */
+static void
+websocket_plugin_setup_monitor (void *cls,
+                                GNUNET_TRANSPORT_SessionInfoCallback sic,
+                                void *sic_cls)
+{
+  struct Plugin *plugin = cls;
+
+  plugin->sic = sic;
+  plugin->sic_cls = sic_cls;
+  if (NULL != sic)
+  {
+    GNUNET_CONTAINER_multipeermap_iterate (plugin->sessions,
+                                           &send_session_info_iter,
+                                           plugin);
+    /* signal end of first iteration */
+    sic (sic_cls, NULL, NULL);
+  }
+}
+
+
+/**
+ * Entry point for the plugin.
+ */
+void *
+libgnunet_plugin_transport_websocket_init (void *cls)
+{
+  struct GNUNET_TRANSPORT_PluginEnvironment *env = cls;
+  struct GNUNET_TRANSPORT_PluginFunctions *api;
+  struct Plugin *plugin;
+  unsigned long long max_connections;
+
+  if (NULL == env->receive)
+  {
+    /* run in 'stub' mode (i.e. as part of gnunet-peerinfo), don't fully
+       initialze the plugin or the API */
+    api = GNUNET_new (struct GNUNET_TRANSPORT_PluginFunctions);
+    api->cls = NULL;
+    api->address_to_string = &websocket_plugin_address_to_string;
+    api->string_to_address = &websocket_plugin_string_to_address;
+    api->address_pretty_printer = &websocket_plugin_address_pretty_printer;
+    return api;
+  }
+
+  plugin = GNUNET_new (struct Plugin);
+  plugin->env = env;
+  plugin->sessions = GNUNET_CONTAINER_multipeermap_create (128,
+                                                           GNUNET_YES);
+  if (GNUNET_OK != GNUNET_CONFIGURATION_get_value_number (env->cfg,
+                      "transport-" PLUGIN_NAME,
+                      "MAX_CONNECTIONS", &max_connections))
+    max_connections = 128;
+  plugin->max_connections = max_connections;
+  api = GNUNET_new (struct GNUNET_TRANSPORT_PluginFunctions);
+  api->cls = plugin;
+  api->send = &websocket_plugin_send;
+  api->disconnect_session = &websocket_plugin_session_disconnect;
+  api->query_keepalive_factor = &websocket_plugin_query_keepalive_factor;
+  api->disconnect_peer = &websocket_plugin_peer_disconnect;
+  api->check_address = &websocket_plugin_address_suggested;
+  api->get_session = &websocket_plugin_get_session;
+  api->address_to_string = &websocket_plugin_address_to_string;
+  api->string_to_address = &websocket_plugin_string_to_address;
+  api->address_pretty_printer = &websocket_plugin_address_pretty_printer;
+  api->get_network = &websocket_plugin_get_network;
+  api->get_network_for_address = &websocket_plugin_get_network_for_address;
+  api->update_session_timeout = &websocket_plugin_update_session_timeout;
+  api->update_inbound_delay = &websocket_plugin_update_inbound_delay;
+  api->setup_monitor = &websocket_plugin_setup_monitor;
+  LOG (GNUNET_ERROR_TYPE_INFO, "WebSocket plugin successfully loaded\n");
+  return api;
+}
+
+
+/**
+ * Exit point from the plugin.
+ *
+ * @param cls api as closure
+ * @return NULL
+ */
+void *
+libgnunet_plugin_transport_websocket_done (void *cls)
+{
+  struct GNUNET_TRANSPORT_PluginFunctions *api = cls;
+  struct Plugin *plugin = api->cls;
+
+  if (NULL == plugin)
+  {
+    /* Stub shutdown */
+    GNUNET_free (api);
+    return NULL;
+  }
+  GNUNET_CONTAINER_multipeermap_iterate (plugin->sessions,
+                                         &destroy_session_cb,
+                                         plugin);
+  GNUNET_CONTAINER_multipeermap_destroy (plugin->sessions);
+  GNUNET_free (plugin);
+  GNUNET_free (api);
+  return NULL;
+}
+
+/* vim: set expandtab ts=2 sw=2: */
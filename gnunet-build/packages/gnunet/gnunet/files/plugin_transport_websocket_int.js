@@ -0,0 +1,100 @@
+// plugin_transport_websocket_int.js - js for websocket transport plugin
+// Copyright (C) 2026  agent <agent@local>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+mergeInto(LibraryManager.library, {
+  $WEBSOCKETS: {},
+  $NEXT_WEBSOCKET: 1,
+  websocket_connect_int__deps: ['$WEBSOCKETS', '$NEXT_WEBSOCKET'],
+  websocket_connect_int: function(url_pointer, s, open_cb, receive_cb,
+                                  close_cb) {
+    var url = UTF8ToString(url_pointer);
+    var handle = NEXT_WEBSOCKET++;
+    var ws;
+    try {
+      ws = new WebSocket(url);
+    } catch (e) {
+      // a malformed URL, a blocked port or mixed content
+      console.error('websocket' + handle + ' ' + url + ': ' + e);
+      return 0;
+    }
+    ws.binaryType = 'arraybuffer';
+    WEBSOCKETS[handle] = ws;
+    var receive = getFuncWrapper(receive_cb, 'iiiii');
+    // Messages the plugin has not taken yet; it takes nothing while it is
+    // out of inbound bandwidth and calls websocket_resume_int when it has
+    // some again
+    ws.held = [];
+    ws.deliver = function() {
+      while (ws.held.length > 0 && WEBSOCKETS[handle] === ws) {
+        var data = ws.held[0];
+        var taken = ccallFunc(receive, 'number',
+          ['array', 'number', 'number', 'number'],
+          [data, data.length, 1, s]);
+        if (0 === taken) {
+          return;
+        }
+        ws.held.shift();
+      }
+    };
+    ws.onopen = function() {
+      //console.debug('websocket' + handle + ' open');
+      dynCall('vi', open_cb, [s]);
+    };
+    ws.onmessage = function(e) {
+      ws.held.push(new Uint8Array(e.data));
+      if (1 == ws.held.length) {
+        ws.deliver();
+      }
+    };
+    ws.onclose = function(e) {
+      //console.debug('websocket' + handle + ' closed: ' + e.code);
+      // only report closes we did not ask for
+      if (WEBSOCKETS[handle] === ws) {
+        delete WEBSOCKETS[handle];
+        dynCall('vi', close_cb, [s]);
+      }
+    };
+    return handle;
+  },
+  websocket_send_int__deps: ['$WEBSOCKETS'],
+  websocket_send_int: function(handle, data_pointer, size) {
+    var ws = WEBSOCKETS[handle];
+    ws.send(HEAPU8.slice(data_pointer, data_pointer + size));
+    return ws.bufferedAmount;
+  },
+  websocket_buffered_int__deps: ['$WEBSOCKETS'],
+  websocket_buffered_int: function(handle) {
+    var ws = WEBSOCKETS[handle];
+    return ws ? ws.bufferedAmount : 0;
+  },
+  websocket_resume_int__deps: ['$WEBSOCKETS'],
+  websocket_resume_int: function(handle) {
+    var ws = WEBSOCKETS[handle];
+    if (ws) {
+      ws.deliver();
+    }
+  },
+  websocket_close_int__deps: ['$WEBSOCKETS'],
+  websocket_close_int: function(handle) {
+    var ws = WEBSOCKETS[handle];
+    if (ws) {
+      delete WEBSOCKETS[handle];
+      ws.close();
+    }
+  }
+});
+
+// vim: set expandtab ts=2 sw=2:
@@ -16,24 +16,214 @@
 
 var xhrs = []; // plugin_transport_http_client
 
+// Paths under an IDBFS mount that changed since the last flush, mapped to
+// their mount.  Only these are written back to IndexedDB; a closed file is
+// flushed almost at once, other changes are coalesced, and nothing is
+// flushed while idle.
+var idbfs_mounts = [];
+var idbfs_dirty = {};
+var idbfs_flushing = false;
+var idbfs_flush_task = null;
+var idbfs_close_delay = 50;
+var idbfs_coalesce_delay = 1000;
+
+function idbfs_mark(path) {
+  if (!path) {
+    return false;
+  }
+  var mount = null;
+  idbfs_mounts.forEach(function(m) {
+    if (path == m || 0 == path.lastIndexOf(m + '/', 0)) {
+      mount = m;
+    }
+  });
+  if (null === mount) {
+    return false;
+  }
+  idbfs_dirty[path] = mount;
+  idbfs_schedule_flush(idbfs_coalesce_delay);
+  return true;
+}
+
+function idbfs_schedule_flush(delay) {
+  if (null !== idbfs_flush_task) {
+    if (idbfs_flush_task.due <= Date.now() + delay) {
+      return;
+    }
+    clearTimeout(idbfs_flush_task.id);
+  }
+  idbfs_flush_task = {
+    due: Date.now() + delay,
+    id: setTimeout(function() {
+      idbfs_flush_task = null;
+      idbfs_flush();
+    }, delay)};
+}
+
+function idbfs_flush() {
+  if (idbfs_flushing) {
+    // picked up again when the running flush completes
+    return;
+  }
+  var paths = Object.keys(idbfs_dirty);
+  if (0 == paths.length) {
+    return;
+  }
+  // one mount, and so one database, per flush
+  var mount = idbfs_dirty[paths[0]];
+  paths = paths.filter(function(path) { return idbfs_dirty[path] == mount; });
+  paths.forEach(function(path) { delete idbfs_dirty[path]; });
+  idbfs_flushing = true;
+  var done = function(failed) {
+    idbfs_flushing = false;
+    if (failed) {
+      // try again later rather than lose the changes
+      paths.forEach(function(path) { idbfs_dirty[path] = mount; });
+    }
+    if (0 != Object.keys(idbfs_dirty).length) {
+      idbfs_schedule_flush(failed ? idbfs_coalesce_delay : 0);
+    }
+  };
+  IDBFS.getDB(mount, function(err, db) {
+    if (err) {
+      console.error('Failed to open IDBFS database', err);
+      done(true);
+      return;
+    }
+    var transaction = db.transaction([IDBFS.DB_STORE_NAME], 'readwrite');
+    var store = transaction.objectStore(IDBFS.DB_STORE_NAME);
+    transaction.oncomplete = function() { done(false); };
+    transaction.onabort = function() {
+      console.error('IDBFS flush failed', transaction.error);
+      done(true);
+    };
+    // parents sort before their children
+    paths.sort().forEach(function(path) {
+      var lookup = FS.analyzePath(path);
+      if (!lookup.exists) {
+        IDBFS.removeRemoteEntry(store, path, function() {});
+        return;
+      }
+      IDBFS.loadLocalEntry(path, function(err, entry) {
+        if (err) {
+          console.error('Failed to read', path, err);
+          return;
+        }
+        IDBFS.storeRemoteEntry(store, path, entry, function() {});
+      });
+    });
+  });
+}
+
+var idbfs_O_CREAT = 64;
+var idbfs_O_TRUNC = 512;
+
+// Mark both the old and the new path of everything in a moved subtree
+function idbfs_mark_moved(old_path, new_path) {
+  idbfs_mark(old_path);
+  idbfs_mark(new_path);
+  var lookup = FS.analyzePath(new_path, true);
+  if (!lookup.exists || !FS.isDir(lookup.object.mode)) {
+    return;
+  }
+  FS.readdir(new_path).forEach(function(name) {
+    if ('.' != name && '..' != name) {
+      idbfs_mark_moved(PATH.join2(old_path, name), PATH.join2(new_path, name));
+    }
+  });
+}
+
+// Track writes to the mounted tree through the FS tracking delegate
+function idbfs_track(mount) {
+  idbfs_mounts.push(mount);
+  if (idbfs_mounts.length > 1) {
+    return;
+  }
+  var delegate = FS.trackingDelegate;
+  delegate['onWriteToFile'] = idbfs_mark;
+  delegate['onMakeDirectory'] = idbfs_mark;
+  // called with the target and then the path of the new link
+  delegate['onMakeSymlink'] = function(old_path, new_path) {
+    idbfs_mark(new_path);
+  };
+  delegate['onDeletePath'] = idbfs_mark;
+  // called after the move, everything below new_path was below old_path
+  delegate['onMovePath'] = function(old_path, new_path) {
+    idbfs_mark_moved(old_path, new_path);
+  };
+  // onOpenFile doesn't tell about O_CREAT and O_TRUNC, and truncate isn't
+  // tracked at all
+  var open = FS.open;
+  FS.open = function(path, flags) {
+    var stream = open.apply(this, arguments);
+    if (typeof flags === 'string') {
+      flags = FS.modeStringToFlags(flags);
+    }
+    if (flags & (idbfs_O_CREAT | idbfs_O_TRUNC)) {
+      idbfs_mark(stream.path);
+    }
+    return stream;
+  };
+  var truncate = FS.truncate;
+  FS.truncate = function(path, len) {
+    var ret = truncate.apply(this, arguments);
+    idbfs_mark(typeof path === 'string' ? FS.lookupPath(path).path
+                                        : FS.getPath(path));
+    return ret;
+  };
+  var close = FS.close;
+  FS.close = function(stream) {
+    var path = stream.path;
+    var ret = close.apply(this, arguments);
+    if (path in idbfs_dirty) {
+      idbfs_schedule_flush(idbfs_close_delay);
+    }
+    return ret;
+  };
+}
+
+// Startup timing, to compare the asm.js and wasm builds and starting with
+// and without a snapshot.  network.js logs the first accepted connection.
+var startup_time = Date.now();
+var window_init_time = null;
+// The same timings for the heap report bench.js reads
+var startup_stats = {
+  build: BUILD_WASM ? 'wasm' : 'asm.js',
+  parsed_ms: null,
+  compiled_ms: null,
+  started_ms: null,
+  snapshot: false,
+  first_accept_ms: null};
+
+// Time from the worker's start until this script ran, which is mostly
+// fetching and parsing it, and with DEBUG=1 the time taken to compile and
+// instantiate the .wasm, including its download when it is streamed
+var script_time = performance.now();
+var wasm_compile_time = null;
+if (BUILD_DEBUG && typeof WebAssembly !== 'undefined') {
+  ['instantiate', 'instantiateStreaming'].forEach(function(name) {
+    var instantiate = WebAssembly[name];
+    if (!instantiate) {
+      return;
+    }
+    WebAssembly[name] = function() {
+      var start = performance.now();
+      return instantiate.apply(WebAssembly, arguments).then(function(result) {
+        // the first is the service, later ones are plugins
+        if (null === wasm_compile_time) {
+          wasm_compile_time = performance.now() - start;
+        }
+        return result;
+      });
+    };
+  });
+}
+
 var dev_urandom_bytes = 0;
 var random_bytes = [];
 var random_offset = 0;
 gnunet_prerun = function() {
   ENV.GNUNET_PREFIX = "/.";
-  [
-    'ats_proportional',
-    'block_dht',
-    'block_fs',
-    'datacache_heap',
-    'datastore_emscripten',
-    'peerstore_emscripten',
-    'transport_http_client',
-    'transport_webrtc',
-  ].forEach(function(plugin) {
-    FS.createPreloadedFile('/', 'libgnunet_plugin_' + plugin + '.js',
-        'libgnunet_plugin_' + plugin + '.js', true, false);
-  });
 
   // Create /dev/urandom that provides strong random bytes from the parent
   // window since workers don't have crypto
@@ -53,31 +243,65 @@ gnunet_prerun = function() {
   FS.unlink('/dev/urandom');
   FS.mkdev('/dev/urandom', id);
 
-  //  Mount IDBFS for services that use it
+  //  Mount IDBFS for services that use it, all of them in the node
+  var mounts = ['peerinfo', 'fs', 'nse', 'datastore'];
   var match = location.pathname.match('gnunet-service-(.*).js');
   if (match) {
-    var service = match[1];
-    var mounts = {peerinfo: true, fs: true, nse: true, datastore: true};
-    if (mounts[service]) {
-      var mount = '/' + service;
-      FS.mkdir(mount);
-      FS.mount(IDBFS, {}, mount);
-      addRunDependency('syncfs');
-      FS.syncfs(true, function() { removeRunDependency('syncfs'); });
-      var syncfs_task;
-      var sync_callback = function() {
-        clearTimeout(syncfs_task);
-        syncfs_task = setTimeout(function() {
-          FS.syncfs(false, sync_callback);
-        }, 5000);
-      };
-      sync_callback();
-    }
+    mounts = mounts.filter(function(service) { return service == match[1]; });
+  } else if (typeof node_start != 'function') {
+    mounts = [];
+  }
+  if (typeof snapshot_build !== 'undefined') {
+    // make-snapshot.js stops before main(), the files are mounted later
+    mounts = [];
+  }
+  mounts.forEach(function(service) {
+    FS.mkdir('/' + service);
+    FS.mount(IDBFS, {}, '/' + service);
+  });
+  if (mounts.length > 0) {
+    addRunDependency('syncfs');
+    FS.syncfs(true, function() {
+      mounts.forEach(function(service) { idbfs_track('/' + service); });
+      removeRunDependency('syncfs');
+    });
   }
   addRunDependency('window-init');
 }
 if (typeof(Module['preInit']) === "undefined") Module = { 'preInit': [] };
 Module['preInit'].push(gnunet_prerun);
+Module['onRuntimeInitialized'] = function() {
+  console.debug(location.pathname + ' (' +
+                (BUILD_WASM ? 'wasm' : 'asm.js') +
+                ') started in ' + (Date.now() - startup_time) + 'ms, ' +
+                (Date.now() - window_init_time) + 'ms after window init');
+  console.debug(location.pathname + ' parsed ' + Math.round(script_time) +
+                'ms after the worker started' +
+                (null === wasm_compile_time ? '' : ', compiled in ' +
+                 Math.round(wasm_compile_time) + 'ms'));
+  startup_stats.parsed_ms = Math.round(script_time);
+  startup_stats.compiled_ms = wasm_compile_time;
+  startup_stats.started_ms = Date.now() - startup_time;
+  startup_stats.snapshot = typeof snapshot_restored !== 'undefined' &&
+                           snapshot_restored;
+  heap_sample();
+  setInterval(heap_sample, 1000);
+};
+
+// Heap usage: the sbrk() break, its high-water mark, and the size of the
+// heap and how often it grew.  malloc() rarely gives memory back, so
+// sampling the break once a second finds the high-water mark.
+var heap_stats = {top: 0, high: 0, size: 0, initial: 0, grown: 0};
+function heap_sample() {
+  heap_stats.top = HEAP32[DYNAMICTOP_PTR >> 2];
+  heap_stats.high = Math.max(heap_stats.high, heap_stats.top);
+  if (0 == heap_stats.initial) {
+    heap_stats.initial = HEAP8.length;
+  } else if (HEAP8.length != heap_stats.size) {
+    heap_stats.grown++;
+  }
+  heap_stats.size = HEAP8.length;
+}
 Module['arguments'] = ["-L", "ERROR"];
 
 // a map of window index to port
@@ -105,19 +329,34 @@ function get_message(ev) {
       FS.writeFile('/private_key', ev.data['private-key'], {encoding: 'binary'});
       random_bytes = ev.data['random-bytes'];
       random_offset = 0;
+      window_init_time = Date.now();
       removeRunDependency('window-init');
     } else if ('connect' == ev.data.type) {
       console.debug("got connect: ", ev.data);
-      SOCKETS.incoming.push(ev.data);
-      if ("listening" in SOCKETS) {
-        var socket = SOCKETS[SOCKETS.listening];
-        if ("task" in socket) {
-          delete SCHEDULER_TASKS[socket.task];
-          delete socket["task"];
-          console.debug("calling handler for listening socket");
-          dynCall('vi', socket["handler"], [socket["cls"]]);
-        }
+      if (typeof node_start == 'function') {
+        node_start(ev.data['service-name']);
+      }
+      socket_incoming(ev.data);
+    } else if ('start' == ev.data.type) {
+      if (typeof node_start == 'function') {
+        node_start(ev.data['service-name']);
+      }
+    } else if ('heap' == ev.data.type) {
+      if (runtimeInitialized) {
+        heap_sample();
       }
+      ev.target.postMessage({
+        type: 'heap',
+        top: heap_stats.top,
+        high: heap_stats.high,
+        size: heap_stats.size,
+        initial: heap_stats.initial,
+        grown: heap_stats.grown,
+        tasks: SCHEDULER_STATS.tasks,
+        busy: SCHEDULER_STATS.busy,
+        sockets: SOCKET_STATS,
+        startup: startup_stats,
+        plugins: typeof PLUGIN_STATS !== 'undefined' ? PLUGIN_STATS : null});
     }
   } catch (e) {
     console.error('Rekt', e);
@@ -16,14 +16,27 @@
 
 mergeInto(LibraryManager.library, {
   $SCHEDULER_TASKS: {},
-  GNUNET_SCHEDULER_add_delayed_with_priority_js__deps: ['$SCHEDULER_TASKS'],
+  // Tasks run and the milliseconds spent in them, for pre.js to report
+  $SCHEDULER_STATS: {tasks: 0, busy: 0},
+  $scheduler_call__deps: ['$SCHEDULER_STATS'],
+  $scheduler_call: function(task, task_cls) {
+    var start = performance.now();
+    try {
+      dynCall('vi', task, [task_cls]);
+    } finally {
+      SCHEDULER_STATS.tasks++;
+      SCHEDULER_STATS.busy += performance.now() - start;
+    }
+  },
+  GNUNET_SCHEDULER_add_delayed_with_priority_js__deps: ['$SCHEDULER_TASKS',
+                                                        '$scheduler_call'],
   GNUNET_SCHEDULER_add_delayed_with_priority_js:
   function(delay, priority, task, task_cls) {
     //console.log('GNUNET_SCHEDULER_add_delayed_with_priority(delay=', delay, ',pirority=', priority, ',task=', task, ',task_cls=', task_cls, ')');
     var id;
     id = setTimeout(function() {
       delete SCHEDULER_TASKS[id];
-      dynCall('vi', task, [task_cls]);
+      scheduler_call(task, task_cls);
     }, delay);
     SCHEDULER_TASKS[id] = {cls: task_cls};
     return id;
@@ -47,7 +60,7 @@ mergeInto(LibraryManager.library, {
     }
     return 0;
   },
-  GNUNET_SCHEDULER_add_read_net__deps: ['$SOCKETS'],
+  GNUNET_SCHEDULER_add_read_net__deps: ['$SOCKETS', '$scheduler_call'],
   GNUNET_SCHEDULER_add_read_net: function(delay, rfd, task, task_cls) {
     //console.debug("add_read_net(", delay, rfd, task, task_cls, ")");
     if (!(rfd in SOCKETS)) {
@@ -59,8 +72,8 @@ mergeInto(LibraryManager.library, {
       console.error("socket already has a read handler");
     }
     var id = setTimeout(function() {
-      if (SOCKETS.listening == rfd) {
-        if (0 == SOCKETS.incoming.length) {
+      if ("incoming" in socket) {
+        if (0 == socket.incoming.length) {
           return;
         }
       } else if (0 == socket.queue.length) {
@@ -71,7 +84,7 @@ mergeInto(LibraryManager.library, {
       }
       delete SCHEDULER_TASKS[id];
       delete socket["task"];
-      dynCall('vi', task, [task_cls]);
+      scheduler_call(task, task_cls);
     }, 0);
     SCHEDULER_TASKS[id] = {
       cls: task_cls,
@@ -90,7 +103,7 @@ mergeInto(LibraryManager.library, {
       task, task_cls) {
     return _GNUNET_SCHEDULER_add_read_net(delay, rfd, task, task_cls);
   },
-  GNUNET_SCHEDULER_add_write_net__deps: ['$SOCKETS'],
+  GNUNET_SCHEDULER_add_write_net__deps: ['$SOCKETS', '$scheduler_call'],
   GNUNET_SCHEDULER_add_write_net: function(delay, wfd, task, task_cls) {
     //console.debug("add_write_net(", delay, wfd, task, task_cls, ")");
     if (!(wfd in SOCKETS)) {
@@ -103,7 +116,7 @@ mergeInto(LibraryManager.library, {
         return;
       }
       delete SCHEDULER_TASKS[id];
-      dynCall('vi', task, [task_cls]);
+      scheduler_call(task, task_cls);
     }, 0);
     SCHEDULER_TASKS[id] = {cls: task_cls};
     return id;
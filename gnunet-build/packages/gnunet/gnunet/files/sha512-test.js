@@ -0,0 +1,170 @@
+// sha512-test.js - check and time the SHA-512s of chk-worker.js
+// Copyright (C) 2026  agent <agent@local>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Usage: node sha512-test.js chk-worker.js
+//
+// Runs the NIST SHA-512 examples through the SIMD128 code of
+// crypto_hash_simd.c and through libgcrypt, then prints how many MB/s each
+// hashes in 32 KiB blocks, the size of a CHK block, followed by the MB/s
+// of the AES-256 and Twofish-256 that GNUNET_CRYPTO_symmetric_encrypt()
+// chains and of a whole CHK encoding.  Exits with 1 if any digest is
+// wrong.  A build without SIMD=1 only has libgcrypt.
+
+var fs = require('fs');
+var path = require('path');
+var vm = require('vm');
+
+var script = path.resolve(process.argv[2]);
+
+// What chk-worker.js expects of a worker
+global.require = require;
+global.__dirname = path.dirname(script);
+global.__filename = script;
+global.location = {pathname: '/js/' + path.basename(script)};
+global.performance = require('perf_hooks').performance;
+global.postMessage = function() {};
+
+// FIPS 180-2 appendix C and the million a's of its long message example
+var vectors = [
+  {name: '"abc"',
+   data: 'abc',
+   digest: 'ddaf35a193617abacc417349ae20413112e6fa4e89a97ea20a9eeee64b55d39a' +
+           '2192992a274fc1a836ba3c23a3feebbd454d4423643ce80e2a9ac94fa54ca49f'},
+  {name: 'empty',
+   data: '',
+   digest: 'cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce' +
+           '47d0d13c5d85f2b0ff8318d2877eec2f63b931bd47417a81a538327af927da3e'},
+  {name: '448 bits',
+   data: 'abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq',
+   digest: '204a8fc6dda82f0a0ced7beb8e08a41657c16ef468b228a8279be331a703c335' +
+           '96fd15c13b1b07f9aa1d3bea57789ca031ad85c7a71dd70354ec631238ca3445'},
+  {name: '896 bits',
+   data: 'abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn' +
+         'hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu',
+   digest: '8e959b75dae313da8cf4f72814fc143f8f7779c6eb9f7fa17299aeadb6889018' +
+           '501d289e4900f7e4331b99dec4b5433ac7d329eeb6dd26545e96e55b874be909'},
+  {name: 'a million a\'s',
+   data: 'a'.repeat(1000000),
+   digest: 'e718483d0ce769644e2e42c7bc15b4638e1f98b13b2044285632a803afa973eb' +
+           'de0ff244877ea60a4cb0432ce577c31beb009c5c2c49aa2e4eadb217ad8cc09b'}
+];
+
+var BLOCK = 32 * 1024;
+var SECONDS = 1;
+
+function hex(bytes) {
+  return Array.prototype.map.call(bytes, function(b) {
+    return (b < 16 ? '0' : '') + b.toString(16);
+  }).join('');
+}
+
+// Hash size bytes at data with hash, return the digest or null if hash
+// is not built in
+function digest(hash, data, size, out) {
+  if (1 != hash(data, size, out)) {
+    return null;
+  }
+  return HEAPU8.slice(out, out + 64);
+}
+
+// Bytes per second f gets through calling it on a BLOCK for SECONDS
+function rate(f) {
+  var count = 0;
+  var start = performance.now();
+  var elapsed;
+  do {
+    f();
+    count++;
+    elapsed = (performance.now() - start) / 1000;
+  } while (elapsed < SECONDS);
+  return count * BLOCK / elapsed;
+}
+
+function run() {
+  var failed = false;
+  var out = _malloc(64);
+  var paths = [
+    {name: 'simd', hash: _GNUNET_CRYPTO_hash_simd},
+    {name: 'gcrypt', hash: function(data, size, out) {
+      _GNUNET_CRYPTO_hash_gcrypt(data, size, out);
+      return 1;
+    }}
+  ];
+  paths.forEach(function(p) {
+    p.built = true;
+    vectors.forEach(function(v) {
+      var bytes = Buffer.from(v.data, 'latin1');
+      var data = _malloc(Math.max(1, bytes.length));
+      HEAPU8.set(bytes, data);
+      var d = digest(p.hash, data, bytes.length, out);
+      _free(data);
+      if (null === d) {
+        p.built = false;
+      } else if (v.digest != hex(d)) {
+        console.log(p.name, v.name + ': got', hex(d));
+        failed = true;
+      } else {
+        console.log(p.name, v.name + ': ok');
+      }
+    });
+  });
+  var block = _malloc(BLOCK);
+  for (var i = 0; i < BLOCK; i++) {
+    HEAPU8[block + i] = i * 7;
+  }
+  paths.forEach(function(p) {
+    if (!p.built) {
+      console.log(p.name + ': not built, build with SIMD=1');
+      return;
+    }
+    console.log(p.name + ':', (rate(function() {
+      p.hash(block, BLOCK, out);
+    }) / 1e6).toFixed(1), 'MB/s');
+  });
+  var ciphers = [
+    {name: 'aes256', run: function() { return _chk_cipher(0, block, BLOCK); }},
+    {name: 'twofish', run: function() { return _chk_cipher(1, block, BLOCK); }},
+    {name: 'chk_encode', run: function() {
+      _chk_encode(block, BLOCK, key, query, enc);
+      return 0;
+    }}
+  ];
+  var key = _malloc(64);
+  var query = _malloc(64);
+  var enc = _malloc(BLOCK);
+  ciphers.forEach(function(c) {
+    if (0 != c.run()) {
+      console.log(c.name + ': failed');
+      failed = true;
+      return;
+    }
+    console.log(c.name + ':', (rate(c.run) / 1e6).toFixed(1), 'MB/s');
+  });
+  _free(enc);
+  _free(query);
+  _free(key);
+  _free(block);
+  _free(out);
+  process.exit(failed ? 1 : 0);
+}
+
+global.Module = {
+  postRun: [run]
+};
+
+vm.runInThisContext(fs.readFileSync(script, 'utf8'), {filename: script});
+
+// vim: set expandtab ts=2 sw=2:
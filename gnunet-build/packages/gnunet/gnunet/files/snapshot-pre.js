@@ -0,0 +1,132 @@
+// snapshot-pre.js - start a service from the heap make-snapshot.js captured
+// Copyright (C) 2026  agent <agent@local>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// A snapshot is the heap of a service after its C constructors ran, which
+// initialize libgcrypt and libgnunetutil, up to the sbrk() break.  It is
+// restored before the constructors would run, and they are skipped.  The
+// file is the magic below, the length of a JSON header as a 32-bit little
+// endian number, the header and the heap.
+var SNAPSHOT_MAGIC = 'gnsnap01';
+
+// getpid() for snapshot.js, 42 like emscripten's until a snapshot is
+// restored
+var snapshot_pid = 42;
+// The fetched snapshot, {header, heap}, until it is restored
+var snapshot = null;
+var snapshot_restored = false;
+
+// The break before anything was allocated, to tell whether a snapshot
+// belongs to this build
+function snapshot_base() {
+  return HEAP32[DYNAMICTOP_PTR >> 2];
+}
+
+function snapshot_parse(buffer) {
+  var bytes = new Uint8Array(buffer);
+  var magic = String.fromCharCode.apply(null, bytes.subarray(0, 8));
+  if (SNAPSHOT_MAGIC != magic) {
+    throw 'bad magic';
+  }
+  var length = new DataView(buffer).getUint32(8, true);
+  var header = JSON.parse(UTF8ArrayToString(bytes.subarray(12, 12 + length),
+                                            0));
+  return {header: header, heap: bytes.subarray(12 + length)};
+}
+
+function snapshot_fetch() {
+  if (typeof snapshot_build !== 'undefined') {
+    return;
+  }
+  var url = location.pathname.replace(/\.js$/, '.snapshot');
+  var start = Date.now();
+  var xhr = new XMLHttpRequest();
+  addRunDependency('snapshot');
+  xhr.open('GET', url);
+  xhr.responseType = 'arraybuffer';
+  xhr.onload = function() {
+    if (200 == xhr.status) {
+      try {
+        snapshot = snapshot_parse(xhr.response);
+        console.debug('fetched', url, xhr.response.byteLength, 'bytes in',
+                      Date.now() - start, 'ms');
+      } catch (e) {
+        console.error('Failed to parse', url, e);
+      }
+    } else {
+      console.error('Failed to fetch', url, xhr.status);
+    }
+    removeRunDependency('snapshot');
+  };
+  xhr.onerror = function() {
+    console.error('Failed to fetch', url);
+    removeRunDependency('snapshot');
+  };
+  xhr.send();
+}
+
+// Runs after the memory initializer and before the constructors
+function snapshot_restore() {
+  if (null === snapshot) {
+    return;
+  }
+  var header = snapshot.header;
+  var heap = snapshot.heap;
+  snapshot = null;
+  if (header.size != HEAP8.length || header.base != snapshot_base() ||
+      heap.length > HEAP8.length) {
+    console.error('Snapshot does not match this build, starting without it');
+    return;
+  }
+  // The constructors must not run again over the restored heap, so without
+  // a way to skip them start cold
+  var ctors;
+  if (typeof ___wasm_call_ctors !== 'undefined') {
+    ctors = '___wasm_call_ctors';
+  } else if (typeof globalCtors !== 'undefined') {
+    ctors = 'globalCtors';
+  } else {
+    console.error('No constructors to skip, starting without the snapshot');
+    return;
+  }
+  var start = Date.now();
+  HEAPU8.set(heap);
+  // Files the constructors left open, libgcrypt keeps /dev/urandom open
+  header.fds.forEach(function(f) {
+    FS.open(f.path, f.flags, 0, f.fd, f.fd).position = f.position;
+  });
+  if ('___wasm_call_ctors' == ctors) {
+    ___wasm_call_ctors = function() {};
+  } else {
+    globalCtors = function() {};
+  }
+  snapshot_restored = true;
+  console.debug('restored', heap.length, 'bytes of heap in',
+                Date.now() - start, 'ms, skipping', ctors);
+}
+
+Module['preInit'].push(snapshot_fetch);
+if (typeof(Module['preRun']) === "undefined") Module['preRun'] = [];
+Module['preRun'].push(snapshot_restore);
+var snapshot_runtime_initialized = Module['onRuntimeInitialized'];
+Module['onRuntimeInitialized'] = function() {
+  if (snapshot_restored) {
+    snapshot_pid++;
+    _GNUNET_SNAPSHOT_restored();
+  }
+  snapshot_runtime_initialized();
+};
+
+// vim: set expandtab ts=2 sw=2:
@@ -0,0 +1,59 @@
+/*
+ * snapshot.c - gnunet-web reseeding after a heap snapshot is restored
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "platform.h"
+#include "gnunet_util_lib.h"
+#include <gcrypt.h>
+
+/**
+ * Called by snapshot-pre.js after it restored a heap captured by
+ * make-snapshot.js, before main().  The constructors that ran for the
+ * snapshot seeded libgcrypt and the weak generator from a /dev/urandom
+ * full of zeros, so every restored copy starts from the same pools.  Mix
+ * in bytes from the window's /dev/urandom.  snapshot.js changed getpid(),
+ * so libgcrypt also stirs its pool and nonce generator as after a fork.
+ */
+void
+GNUNET_SNAPSHOT_restored (void)
+{
+  unsigned char buf[64];
+  unsigned int seed;
+  ssize_t got;
+  int fd;
+
+  fd = open ("/dev/urandom", O_RDONLY);
+  if (-1 == fd)
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR, "open", "/dev/urandom");
+    GNUNET_abort_ ();
+  }
+  got = read (fd, buf, sizeof (buf));
+  close (fd);
+  if (sizeof (buf) != got)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "Short read from /dev/urandom after restoring a snapshot\n");
+    GNUNET_abort_ ();
+  }
+  gcry_random_add_bytes (buf, sizeof (buf), -1);
+  GNUNET_memcpy (&seed, buf, sizeof (seed));
+  GNUNET_CRYPTO_seed_weak_random (seed);
+  memset (buf, 0, sizeof (buf));
+}
+
+/* vim: set expandtab ts=2 sw=2: */
@@ -0,0 +1,26 @@
+// snapshot.js - process id for services restored from a heap snapshot
+// Copyright (C) 2026  agent <agent@local>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+mergeInto(LibraryManager.library, {
+  // libgcrypt compares getpid() with the pid it saw when it seeded its pool
+  // and nonce generator, and stirs them when it changed, as after a fork.
+  // snapshot-pre.js changes snapshot_pid once it restored a snapshot.
+  getpid: function() {
+    return snapshot_pid;
+  },
+});
+
+// vim: set expandtab ts=2 sw=2:
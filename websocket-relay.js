@@ -0,0 +1,151 @@
+#!/usr/bin/env node
+// websocket-relay.js - local stand-in for a WebSocket transport peer
+// Copyright (C) 2026  agent <agent@local>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Usage: node websocket-relay.js [--echo] [port]
+//
+// Accepts WebSocket connections on localhost.  Every binary message is
+// relayed to all other connected clients, or with --echo sent back to its
+// sender, so the websocket transport can be exercised on loopback.  Only
+// node's standard library is used.
+
+var crypto = require('crypto');
+var http = require('http');
+
+var echo = process.argv.indexOf('--echo') >= 0;
+var port = parseInt(process.argv.filter(function(arg) {
+  return /^[0-9]+$/.test(arg);
+})[0] || '8080', 10);
+var GUID = '258EAFA5-E914-47DA-95CA-C5AB0DC85B11';
+var clients = [];
+var stats = {messages: 0, bytes: 0};
+
+function frame(opcode, payload) {
+  var header;
+  if (payload.length < 126) {
+    header = Buffer.from([0x80 | opcode, payload.length]);
+  } else if (payload.length < 65536) {
+    header = Buffer.from([0x80 | opcode, 126, 0, 0]);
+    header.writeUInt16BE(payload.length, 2);
+  } else {
+    header = Buffer.from([0x80 | opcode, 127, 0, 0, 0, 0, 0, 0, 0, 0]);
+    header.writeUInt32BE(payload.length, 6);
+  }
+  return Buffer.concat([header, payload]);
+}
+
+function relay(from, message) {
+  stats.messages++;
+  stats.bytes += message.length;
+  var data = frame(2, message);
+  if (echo) {
+    from.write(data);
+    return;
+  }
+  clients.forEach(function(client) {
+    if (client !== from) {
+      client.write(data);
+    }
+  });
+}
+
+// Parse client frames out of buf; returns the unparsed remainder
+function parse(socket, buf) {
+  while (buf.length >= 2) {
+    var opcode = buf[0] & 0x0f;
+    var fin = buf[0] & 0x80;
+    var length = buf[1] & 0x7f;
+    var offset = 2;
+    if (126 == length) {
+      if (buf.length < 4) break;
+      length = buf.readUInt16BE(2);
+      offset = 4;
+    } else if (127 == length) {
+      if (buf.length < 10) break;
+      length = buf.readUInt32BE(6);
+      offset = 10;
+    }
+    // client frames are always masked
+    if (buf.length < offset + 4 + length) break;
+    var mask = buf.slice(offset, offset + 4);
+    var payload = Buffer.alloc(length);
+    for (var i = 0; i < length; i++) {
+      payload[i] = buf[offset + 4 + i] ^ mask[i & 3];
+    }
+    buf = buf.slice(offset + 4 + length);
+    if (8 == opcode) {
+      socket.end(frame(8, Buffer.alloc(0)));
+      break;
+    } else if (9 == opcode) {
+      socket.write(frame(10, payload));
+    } else if (0 == opcode || 1 == opcode || 2 == opcode) {
+      socket.fragments = (socket.fragments || []).concat([payload]);
+      if (fin) {
+        relay(socket, Buffer.concat(socket.fragments));
+        socket.fragments = [];
+      }
+    }
+  }
+  return buf;
+}
+
+var server = http.createServer(function(req, res) {
+  res.writeHead(426, {'Content-Type': 'text/plain'});
+  res.end('WebSocket only\n');
+});
+server.on('upgrade', function(req, socket) {
+  var key = req.headers['sec-websocket-key'];
+  if (!key) {
+    socket.destroy();
+    return;
+  }
+  var accept = crypto.createHash('sha1').update(key + GUID).digest('base64');
+  socket.write('HTTP/1.1 101 Switching Protocols\r\n' +
+               'Upgrade: websocket\r\n' +
+               'Connection: Upgrade\r\n' +
+               'Sec-WebSocket-Accept: ' + accept + '\r\n\r\n');
+  socket.setNoDelay(true);
+  clients.push(socket);
+  console.log('client connected, ' + clients.length + ' total');
+  var pending = Buffer.alloc(0);
+  socket.on('data', function(data) {
+    pending = parse(socket, Buffer.concat([pending, data]));
+  });
+  var remove = function() {
+    var i = clients.indexOf(socket);
+    if (i >= 0) {
+      clients.splice(i, 1);
+      console.log('client disconnected, ' + clients.length + ' total');
+    }
+  };
+  socket.on('close', remove);
+  socket.on('error', remove);
+});
+server.listen(port, 'localhost', function() {
+  console.log((echo ? 'echoing' : 'relaying') + ' on ws://localhost:' + port +
+              '/');
+});
+setInterval(function() {
+  if (stats.messages > 0) {
+    console.log(JSON.stringify({
+      interval_s: 10,
+      messages: stats.messages,
+      bytes: stats.bytes}));
+    stats = {messages: 0, bytes: 0};
+  }
+}, 10000);
+
+// vim: set expandtab ts=2 sw=2: